@@ -0,0 +1,158 @@
+// AXI4 read master. Streams [base, base + length) from memory through a
+// prefetch FIFO, and outputs it OUT_WIDTH bits at a time.
+//
+// Bursts are issued ahead of consumption, as long as the FIFO has room for all
+// beats in flight and fewer than cfg_max_outstanding bursts are pending. Bursts
+// never cross a BURST_BEATS aligned boundary, so they never cross a 4 KB page.
+module axi_dma #(
+    parameter ADDR_WIDTH = 32,
+    parameter DATA_WIDTH = 256,
+    parameter OUT_WIDTH = 8,
+    parameter ID_WIDTH = 4,
+    parameter ID = 0,
+    parameter BURST_BEATS = 16,
+    parameter MAX_OUTSTANDING = 8,
+    parameter FIFO_DEPTH = 64
+)(
+    input                       clk,
+    input                       rst,
+
+    // Descriptor. base must be beat aligned, length is in bytes and a multiple of OUT_WIDTH / 8.
+    input                       start,
+    input  [ADDR_WIDTH-1:0]     base,
+    input  [ADDR_WIDTH-1:0]     length,
+    output                      busy,
+    output                      idle,           // Waiting on read data: no request to issue, no output
+
+    // Runtime limits (at most MAX_OUTSTANDING and FIFO_DEPTH), to explore the prefetch depth needed.
+    input  [15:0]               cfg_max_outstanding,
+    input  [15:0]               cfg_fifo_beats,
+
+    // AXI4 read address channel
+    output reg                  m_axi_arvalid,
+    input                       m_axi_arready,
+    output reg [ADDR_WIDTH-1:0] m_axi_araddr,
+    output reg [7:0]            m_axi_arlen,
+    output     [2:0]            m_axi_arsize,
+    output     [1:0]            m_axi_arburst,
+    output     [ID_WIDTH-1:0]   m_axi_arid,
+
+    // AXI4 read data channel
+    input                       m_axi_rvalid,
+    output                      m_axi_rready,
+    input  [DATA_WIDTH-1:0]     m_axi_rdata,
+    input                       m_axi_rlast,
+
+    // Output stream
+    output                      out_valid,
+    input                       out_ready,
+    output [OUT_WIDTH-1:0]      out_data
+);
+    localparam BEAT_BYTES = DATA_WIDTH / 8;
+    localparam BEAT_SHIFT = $clog2(BEAT_BYTES);
+    localparam OUT_SHIFT = $clog2(OUT_WIDTH / 8);
+    localparam SUBWORDS = DATA_WIDTH / OUT_WIDTH;
+    localparam SUB_WIDTH = SUBWORDS > 1 ? $clog2(SUBWORDS) : 1;
+    localparam BURST_SHIFT = $clog2(BURST_BEATS);
+    localparam PTR_WIDTH = $clog2(FIFO_DEPTH);
+
+    localparam [2:0] ARSIZE = BEAT_SHIFT;
+    localparam [ID_WIDTH-1:0] ARID = ID;
+    localparam [15:0] BURST_BEATS_W = BURST_BEATS;
+    localparam [15:0] MAX_OUTSTANDING_W = MAX_OUTSTANDING;
+    localparam [15:0] FIFO_DEPTH_W = FIFO_DEPTH;
+    localparam [SUB_WIDTH-1:0] LAST_SUB = SUBWORDS - 1;
+
+    assign m_axi_arsize = ARSIZE;
+    assign m_axi_arburst = 2'b01; // INCR
+    assign m_axi_arid = ARID;
+    // FIFO space is reserved when a burst is issued, so data can always be accepted.
+    assign m_axi_rready = 1'b1;
+
+    // Address side
+    reg [ADDR_WIDTH-1:0] ar_addr;     // Next address to request
+    reg [ADDR_WIDTH-1:0] ar_beats;    // Beats still to request
+    reg [15:0]           inflight;    // Beats requested, but not received yet
+    reg [15:0]           outstanding; // Bursts requested, but not completed yet
+
+    // Prefetch FIFO, pointers have an extra wrap bit.
+    reg [DATA_WIDTH-1:0] fifo [0:FIFO_DEPTH-1];
+    reg [PTR_WIDTH:0]    wr_ptr;
+    reg [PTR_WIDTH:0]    rd_ptr;
+    wire [15:0] fifo_count = {{(15-PTR_WIDTH){1'b0}}, wr_ptr - rd_ptr};
+
+    // Output side
+    reg [ADDR_WIDTH-1:0] out_left;    // Output words still to deliver
+    reg [SUB_WIDTH-1:0]  sub;         // Output word within the head beat
+
+    // Next burst: up to BURST_BEATS, without crossing a burst aligned boundary.
+    wire [15:0] to_boundary = BURST_BEATS_W - {{(16-BURST_SHIFT){1'b0}}, ar_addr[BEAT_SHIFT +: BURST_SHIFT]};
+    wire [15:0] burst = (ar_beats < {{(ADDR_WIDTH-16){1'b0}}, to_boundary}) ? ar_beats[15:0] : to_boundary;
+
+    wire r_fire = m_axi_rvalid && m_axi_rready;
+    wire [15:0] max_outstanding = cfg_max_outstanding < MAX_OUTSTANDING_W ? cfg_max_outstanding : MAX_OUTSTANDING_W;
+    wire [15:0] fifo_beats = cfg_fifo_beats < FIFO_DEPTH_W ? cfg_fifo_beats : FIFO_DEPTH_W;
+    wire issue = !start && (!m_axi_arvalid || m_axi_arready) && ar_beats != 0
+        && outstanding < max_outstanding
+        && inflight + fifo_count + burst <= fifo_beats;
+
+    wire [DATA_WIDTH-1:0] head = fifo[rd_ptr[PTR_WIDTH-1:0]];
+    assign out_data = head[sub * OUT_WIDTH +: OUT_WIDTH];
+    assign out_valid = fifo_count != 0 && out_left != 0;
+    wire out_fire = out_valid && out_ready;
+
+    assign busy = ar_beats != 0 || outstanding != 0 || out_left != 0;
+    // Until read data arrives (or start), the next edge changes nothing.
+    assign idle = !start && !issue && !m_axi_arvalid && !out_valid;
+
+    always @(posedge clk) begin
+        if (rst) begin
+            m_axi_arvalid <= 0;
+            ar_addr <= 0;
+            ar_beats <= 0;
+            inflight <= 0;
+            outstanding <= 0;
+            wr_ptr <= 0;
+            rd_ptr <= 0;
+            out_left <= 0;
+            sub <= 0;
+        end else begin
+            if (m_axi_arvalid && m_axi_arready) begin
+                m_axi_arvalid <= 0;
+            end
+
+            if (start && !busy) begin
+                ar_addr <= base;
+                ar_beats <= (length + BEAT_BYTES - 1) >> BEAT_SHIFT;
+                out_left <= length >> OUT_SHIFT;
+                sub <= 0;
+            end else if (issue) begin
+                m_axi_arvalid <= 1;
+                m_axi_araddr <= ar_addr;
+                m_axi_arlen <= burst[7:0] - 8'd1;
+                ar_addr <= ar_addr + ({{(ADDR_WIDTH-16){1'b0}}, burst} << BEAT_SHIFT);
+                ar_beats <= ar_beats - {{(ADDR_WIDTH-16){1'b0}}, burst};
+            end
+
+            inflight <= inflight + (issue ? burst : 16'd0) - (r_fire ? 16'd1 : 16'd0);
+            outstanding <= outstanding + (issue ? 16'd1 : 16'd0) - (r_fire && m_axi_rlast ? 16'd1 : 16'd0);
+
+            if (r_fire) begin
+                fifo[wr_ptr[PTR_WIDTH-1:0]] <= m_axi_rdata;
+                wr_ptr <= wr_ptr + 1;
+            end
+
+            if (out_fire) begin
+                out_left <= out_left - 1;
+                if (sub == LAST_SUB || out_left == 1) begin
+                    // Done with the head beat.
+                    rd_ptr <= rd_ptr + 1;
+                    sub <= 0;
+                end else begin
+                    sub <= sub + 1;
+                end
+            end
+        end
+    end
+
+endmodule
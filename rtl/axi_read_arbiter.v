@@ -0,0 +1,98 @@
+// Shares one AXI4 read port between two masters.
+//
+// Address requests are granted round-robin. A granted request is held until it
+// is accepted, so the address channel never changes while valid. Read data is
+// routed back by RID, so each master must use a distinct ID (M0_ID, M1_ID).
+module axi_read_arbiter #(
+    parameter ADDR_WIDTH = 32,
+    parameter DATA_WIDTH = 256,
+    parameter ID_WIDTH = 4,
+    parameter M0_ID = 0,
+    parameter M1_ID = 1
+)(
+    input                       clk,
+    input                       rst,
+
+    // Master 0
+    input                       m0_arvalid,
+    output                      m0_arready,
+    input  [ADDR_WIDTH-1:0]     m0_araddr,
+    input  [7:0]                m0_arlen,
+    input  [2:0]                m0_arsize,
+    input  [1:0]                m0_arburst,
+    input  [ID_WIDTH-1:0]       m0_arid,
+    output                      m0_rvalid,
+    input                       m0_rready,
+
+    // Master 1
+    input                       m1_arvalid,
+    output                      m1_arready,
+    input  [ADDR_WIDTH-1:0]     m1_araddr,
+    input  [7:0]                m1_arlen,
+    input  [2:0]                m1_arsize,
+    input  [1:0]                m1_arburst,
+    input  [ID_WIDTH-1:0]       m1_arid,
+    output                      m1_rvalid,
+    input                       m1_rready,
+
+    // Shared read data, to both masters
+    output [DATA_WIDTH-1:0]     rdata,
+    output                      rlast,
+
+    // Slave port
+    output                      s_arvalid,
+    input                       s_arready,
+    output [ADDR_WIDTH-1:0]     s_araddr,
+    output [7:0]                s_arlen,
+    output [2:0]                s_arsize,
+    output [1:0]                s_arburst,
+    output [ID_WIDTH-1:0]       s_arid,
+    input                       s_rvalid,
+    output                      s_rready,
+    input  [DATA_WIDTH-1:0]     s_rdata,
+    input  [ID_WIDTH-1:0]       s_rid,
+    input                       s_rlast
+);
+    localparam [ID_WIDTH-1:0] ID0 = M0_ID;
+    localparam [ID_WIDTH-1:0] ID1 = M1_ID;
+
+    reg last;       // Master granted most recently
+    reg hold;       // A granted request is waiting for s_arready
+    reg hold_sel;   // Master of that request
+
+    wire sel = hold ? hold_sel
+        : (m0_arvalid && m1_arvalid) ? !last
+        : m1_arvalid;
+
+    assign s_arvalid = sel ? m1_arvalid : m0_arvalid;
+    assign s_araddr = sel ? m1_araddr : m0_araddr;
+    assign s_arlen = sel ? m1_arlen : m0_arlen;
+    assign s_arsize = sel ? m1_arsize : m0_arsize;
+    assign s_arburst = sel ? m1_arburst : m0_arburst;
+    assign s_arid = sel ? m1_arid : m0_arid;
+    assign m0_arready = !sel && s_arready;
+    assign m1_arready = sel && s_arready;
+
+    // Read data goes to the master that owns the ID.
+    wire r_sel = s_rid == ID1;
+    assign m0_rvalid = s_rvalid && s_rid == ID0;
+    assign m1_rvalid = s_rvalid && r_sel;
+    assign s_rready = r_sel ? m1_rready : m0_rready;
+    assign rdata = s_rdata;
+    assign rlast = s_rlast;
+
+    always @(posedge clk) begin
+        if (rst) begin
+            last <= 1;
+            hold <= 0;
+            hold_sel <= 0;
+        end else begin
+            hold <= s_arvalid && !s_arready;
+            hold_sel <= sel;
+            if (s_arvalid && s_arready) begin
+                last <= sel;
+            end
+        end
+    end
+
+endmodule
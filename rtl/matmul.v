@@ -1,121 +1,416 @@
+// Matrix-vector multiplication core.
+//
+// The matrix is streamed in row-major order, LANES elements (one beat) per
+// cycle. Rows start on a beat boundary; lanes beyond hdim in the last beat of
+// a row are ignored. The vector is read from SRAM, LANES elements per word,
+// so element i lives in word i / LANES, lane i % LANES. A row can therefore be
+// at most SRAM depth * LANES elements long; longer rows are tiled by the host.
+//
+// With ROWS > 1, ROWS rows are processed at once: an input beat holds the same
+// LANES columns of ROWS consecutive rows (row r in bits [r*LANES*WEIGHT_BITS +:
+// LANES*WEIGHT_BITS]), and each vector word is shared by all of them. The
+// results of a group of rows are output together, row r in out_data[r*32 +: 32]
+// (for BATCH = 1). If vdim is not a multiple of ROWS, the last group is padded
+// with zero rows by the host.
+//
+// With BATCH > 1, each SRAM word holds the same LANES elements of BATCH
+// vectors (vector b in bits [b*LANES*8 +: LANES*8]), and every weight is
+// multiplied with all of them, so the matrix is streamed once for BATCH
+// vectors. The result of row r for vector b is out_data[(r*BATCH + b)*32 +: 32].
+//
+// With WEIGHT_BITS = 4, weights are unsigned 4-bit values (element i of a row
+// in bits [i*4 +: 4]) quantized in groups of LANES elements, i.e. one group
+// per beat. Each group has a 16-bit scale: the group's dot product d adds
+// (d * scale + 2^(SCALE_SHIFT-1)) >> SCALE_SHIFT to the row sum. The scales
+// are sent in-band: every run of up to LANES/4 weight beats of a row is
+// preceded by a scale beat holding their scales (scale k of row r in bits
+// [r*LANES*4 + k*16 +: 16]). The last run of a row may be shorter.
+//
+// With SPARSE = 1, the matrix is 2:4 structured sparse: of every 4 columns (aligned),
+// at most 2 are non-zero. A weight beat holds LANES values covering 2*LANES
+// columns, 2 per group of 4 columns: value i is column 4*(i/2) + index i of
+// its group. The 2-bit indices are sent in-band like the scales above: every
+// run of up to 4 weight beats of a row is preceded by an index beat (index i
+// of beat k of row r in bits [r*LANES*8 + (k*LANES + i)*2 +: 2]). Vector SRAM
+// words then hold 2*LANES elements, so each beat gathers its vector elements
+// from one word, and a row takes half the MAC cycles. Requires WEIGHT_BITS = 8.
+//
+// After reset the core accepts one matrix; start (while idle) accepts the next
+// one, e.g. after the vector SRAM has been switched to the next vector.
+//
+// The LANES products are reduced by a pipelined adder tree, and accumulated
+// per row. The whole pipeline stalls while a result waits at the output.
+// TREE_LEVELS_PER_STAGE > 1 registers only every so many tree levels (and the
+// root): a shorter pipeline, with a longer path per stage. With ACC_WIDTH < 32
+// the results are the row sums modulo 2^ACC_WIDTH, zero extended.
+//
+// Performance counters (see perf_counters.v) are read and written through the
+// csr_* ports, at these addresses:
+//   0 cycles
+//   1 busy: a beat was accepted (weight or metadata beat)
+//   2 input starved: the core was ready, but in_valid was low
+//   3 output backpressure: a result waited for out_ready
+//   4 row groups completed (ROWS rows each)
+//   5 vector SRAM reads, one per weight beat
 module matmul #(
-    parameter MAX_DIM = 16,
-    parameter SRAM_ADDR_WIDTH = 10
+    parameter SRAM_ADDR_WIDTH = 10,
+    parameter LANES = 32,
+    parameter ROWS = 1,
+    parameter BATCH = 1,
+    parameter DIM_WIDTH = 16,
+    parameter WEIGHT_BITS = 8,                  // 8, or 4 for group quantized weights
+    parameter SCALE_SHIFT = 8,                  // Fraction bits of the group scales
+    parameter SPARSE = 0,                       // 1 for 2:4 sparse weights
+    parameter COUNTER_WIDTH = 32,               // Performance counters
+    parameter ACC_WIDTH = 32,                   // Row sums wrap at 2^ACC_WIDTH (at most 32)
+    parameter TREE_LEVELS_PER_STAGE = 1         // Adder tree levels between pipeline registers
 )(
-    input         clk,
-    input         rst,
-    input  [7:0]  in_data,
-    input         in_valid,
-    output reg    in_ready,
-    
+    input                            clk,
+    input                            rst,
+    input                            start,
+    input  [ROWS*LANES*WEIGHT_BITS-1:0] in_data,
+    input                            in_valid,
+    output                           in_ready,
+
     // New dimension inputs
-    input  [7:0]  vdim,
-    input  [7:0]  hdim,
+    input  [DIM_WIDTH-1:0]           vdim,
+    input  [DIM_WIDTH-1:0]           hdim,
+
+    output reg [ROWS*BATCH*32-1:0]   out_data,
+    output reg                       out_valid,
+    input                            out_ready,
+    output                           idle,      // Pipeline empty, no result waiting
 
-    output reg [31:0] out_data,
-    output reg        out_valid,
-    input             out_ready,
-    
     // SRAM interface for vector data
-    output reg                    vec_sram_we,
-    output reg [SRAM_ADDR_WIDTH-1:0] vec_sram_addr,
-    input      [7:0]              vec_sram_dout
+    output reg                       vec_sram_we,
+    output [SRAM_ADDR_WIDTH-1:0]     vec_sram_addr,
+    input  [BATCH*LANES*(SPARSE+1)*8-1:0] vec_sram_dout,
+
+    // Performance counter registers
+    input  [2:0]                     csr_addr,
+    input                            csr_we,
+    input  [COUNTER_WIDTH-1:0]       csr_wdata,
+    output [COUNTER_WIDTH-1:0]       csr_rdata
 );
 
-    // Stage 0: Initiate SRAM fetch.
-    reg stage0_valid;
-    reg [7:0] stage0_row_idx;
-    reg [$clog2(MAX_DIM)-1:0] stage0_col_idx;
-    reg [7:0] stage0_matrix_element;
-    reg stage0_row_done;
-
-    // Stage 1 waits for SRAM.
-    reg stage1_valid;
-    reg stage1_ready;
-    assign stage1_ready = !stage1_valid || stage2_ready;
-    reg stage1_row_done;
-    reg [7:0] stage1_matrix_element;
-
-    // Stage 2 does the multiplication and accumulation and outputs the result.
-    reg stage2_valid;
-    reg stage2_ready;
-    assign stage2_ready = !stage2_valid || out_ready;
-    reg [31:0] acc; // Accumulator for the current row.
-
-    // Output:
-    assign out_valid = stage2_valid;
-
-    // Stage 0: Process input matrix elements
+    localparam QUANT = WEIGHT_BITS == 4;
+    localparam ROW_BITS = LANES * WEIGHT_BITS;  // Bits of one row in a beat
+    localparam LANE_BITS = $clog2(LANES);
+    localparam LEVELS = LANE_BITS;              // Adder tree depth
+    localparam PROD_WIDTH = WEIGHT_BITS + 8;    // Weight x 8 bit product
+    localparam ROOT_WIDTH = PROD_WIDTH + LEVELS;
+    localparam VEC_LANES = LANES * (SPARSE + 1); // Elements per vector word
+    localparam VEC_LANE_BITS = $clog2(VEC_LANES);
+    localparam META = QUANT || SPARSE;          // Scale or index beats in the stream
+    localparam RUN = QUANT ? ROW_BITS / 16 : SPARSE ? 4 : 1; // Weight beats per metadata beat
+    localparam [31:0] VEC_LANES_W = VEC_LANES;
+    localparam [31:0] ROWS_W = ROWS;
+    localparam [31:0] RUN_W = RUN;
+
+    // Bit offset of each adder tree level in the tree register. Level 0 holds
+    // the products, level l holds LANES >> l sums of PROD_WIDTH + l bits.
+    function integer tree_offset(input integer level);
+        integer k;
+        begin
+            tree_offset = 0;
+            for (k = 0; k < level; k = k + 1) begin
+                tree_offset = tree_offset + (LANES >> k) * (PROD_WIDTH + k);
+            end
+        end
+    endfunction
+
+    // Whether tree level l (1..LEVELS) ends in a register, and how many do.
+    function integer tree_stage(input integer level);
+        tree_stage = level % TREE_LEVELS_PER_STAGE == 0 || level == LEVELS ? 1 : 0;
+    endfunction
+
+    function integer tree_stages(input integer levels);
+        integer k;
+        begin
+            tree_stages = 0;
+            for (k = 1; k <= levels; k = k + 1) begin
+                tree_stages = tree_stages + tree_stage(k);
+            end
+        end
+    endfunction
+
+    localparam TREE_STAGES = tree_stages(LEVELS);
+    localparam DEPTH = TREE_STAGES + QUANT;     // Pipeline stages after stage 0
+    localparam [31:0] ACC_MASK = ACC_WIDTH >= 32 ? 32'hFFFFFFFF : (32'd1 << ACC_WIDTH) - 32'd1;
+    localparam TREE_BITS = tree_offset(LEVELS + 1);
+    localparam ROOT_OFFSET = tree_offset(LEVELS);
+
+    // The pipeline only advances when the output register is free.
+    wire advance = !out_valid || out_ready;
+
+    // Input is accepted while rows are left.
+    reg rows_left;
+    assign in_ready = rows_left && advance;
+    wire in_fire = in_valid && in_ready;
+
+    // Stage 0: Accept a beat of the matrix, and fetch the matching vector word.
+    // Counters are compared at 32 bits, wide enough for any dimension and SRAM depth.
+    reg [DIM_WIDTH-1:0] row_idx;                // First row of the current group
+    reg [SRAM_ADDR_WIDTH-1:0] col_idx;          // Beat within the current row, and its vector word
+    wire [31:0] vdim_w = {{(32-DIM_WIDTH){1'b0}}, vdim};
+    wire [31:0] hdim_w = {{(32-DIM_WIDTH){1'b0}}, hdim};
+    wire [31:0] col_idx_w = {{(32-SRAM_ADDR_WIDTH){1'b0}}, col_idx};
+    wire [31:0] row_beats = (hdim_w + VEC_LANES_W - 32'd1) >> VEC_LANE_BITS;
+    wire last_beat = col_idx_w + 32'd1 == row_beats;
+    wire [31:0] col_base = col_idx_w << VEC_LANE_BITS;
+
+    // Metadata (group scales or sparse indices): the last metadata beat, and
+    // whether it still covers the next beat. Unused without META.
+    /* verilator lint_off UNUSEDSIGNAL */
+    reg [ROWS*ROW_BITS-1:0] meta;
+    reg [ROWS*16-1:0] s0_scale;
+    reg [ROWS*LANES*2-1:0] s0_index;
+    /* verilator lint_on UNUSEDSIGNAL */
+    reg have_meta;
+    wire [31:0] run_idx = col_idx_w % RUN_W;
+    wire meta_beat = META && !have_meta;
+    wire last_run_beat = run_idx + 32'd1 == RUN_W || last_beat;
+
+    reg s0_valid;
+    reg s0_row_done;
+    reg [ROWS*ROW_BITS-1:0] s0_weights;
+    reg [LANES-1:0] s0_mask;
+    reg [SRAM_ADDR_WIDTH-1:0] s0_addr;
+
+    // Lanes of this beat that are within the row (for SPARSE, whose group of
+    // columns starts within the row), and the scale or indices of each row.
+    wire [LANES-1:0] lane_mask;
+    wire [ROWS*16-1:0] beat_scale;
+    wire [ROWS*LANES*2-1:0] beat_index;
+    genvar l, i;
+    generate
+        for (l = 0; l < LANES; l = l + 1) begin : mask_gen
+            localparam [31:0] LANE_COL = SPARSE ? (l / 2) * 4 : l;
+            assign lane_mask[l] = col_base + LANE_COL < hdim_w;
+        end
+        for (l = 0; l < ROWS; l = l + 1) begin : meta_gen
+            if (QUANT) begin : quant
+                assign beat_scale[l*16 +: 16] = meta[l*ROW_BITS + run_idx*16 +: 16];
+            end else begin : no_quant
+                assign beat_scale[l*16 +: 16] = 16'd0;
+            end
+            if (SPARSE) begin : sparse
+                assign beat_index[l*LANES*2 +: LANES*2] = meta[l*ROW_BITS + run_idx*LANES*2 +: LANES*2];
+            end else begin : dense
+                assign beat_index[l*LANES*2 +: LANES*2] = {(LANES*2){1'b0}};
+            end
+        end
+    endgenerate
+
+    // The SRAM output is registered: address the word of the incoming beat, or
+    // keep addressing the word of stage 0 while it is held.
+    assign vec_sram_addr = in_fire ? col_idx : s0_addr;
+
     always @(posedge clk) begin
         if (rst) begin
-            in_ready <= 1;
+            rows_left <= 1;
             vec_sram_we <= 0;
-            stage0_valid <= 0;
-            stage0_col_idx <= 0;
-            stage0_row_idx <= 0;
-            stage0_row_done <= 0;
+            have_meta <= 0;
+            s0_valid <= 0;
+            s0_row_done <= 0;
+            s0_addr <= 0;
+            row_idx <= 0;
+            col_idx <= 0;
         end else begin
-            if (in_valid && stage1_ready) begin
-                // Pre-fetch the vector element for the next cycle
-                // Also pipeline the matrix element, as it arrives in this cycle.
-                $display("Fetching vector element at col_idx=%d", stage0_col_idx);
-                vec_sram_we <= 0;
-                vec_sram_addr <= {6'b0, stage0_col_idx};
-                stage0_col_idx <= stage0_col_idx + 1;
-                stage0_matrix_element <= in_data;
-                stage0_valid <= 1;
-
-                if ({4'b0, stage0_col_idx} + 1 == hdim) begin
-                    stage0_row_done <= 1;
-                    stage0_col_idx <= 0;
-                    stage0_row_idx <= stage0_row_idx + 1;
-                    if (stage0_row_idx + 1 == vdim) begin
-                        // We're done with all matrix rows
-                        in_ready <= 0;  // Stop accepting new input until reset
+            if (advance) begin
+                s0_valid <= in_fire && !meta_beat;
+                if (in_fire && meta_beat) begin
+                    meta <= in_data;
+                    have_meta <= 1;
+                end else if (in_fire) begin
+`ifdef MATMUL_DEBUG
+                    $display("Fetching vector word at col_idx=%d", col_idx);
+`endif
+                    s0_weights <= in_data;
+                    s0_scale <= beat_scale;
+                    s0_index <= beat_index;
+                    s0_mask <= lane_mask;
+                    s0_addr <= col_idx;
+                    s0_row_done <= last_beat;
+                    if (last_run_beat) begin
+                        have_meta <= 0;
+                    end
+                    if (last_beat) begin
+                        col_idx <= 0;
+                        row_idx <= row_idx + ROWS_W[DIM_WIDTH-1:0];
+                        if ({{(32-DIM_WIDTH){1'b0}}, row_idx} + ROWS_W >= vdim_w) begin
+                            // We're done with all matrix rows
+                            rows_left <= 0;  // Stop accepting new input until start
+                        end
+                    end else begin
+                        col_idx <= col_idx + 1;
                     end
-                end else begin
-                    stage0_row_done <= 0;
-                end                        
-            end else if (stage1_ready) begin
-                stage0_valid <= 0;
+                end
+            end
+            // Only given while idle, so no beat is accepted in the same cycle.
+            if (start) begin
+                rows_left <= 1;
+                have_meta <= 0;
+                row_idx <= 0;
+                col_idx <= 0;
             end
         end
     end
 
-    // Stage 1: wait for SRAM data.
+    // Stage 1 (tree level 0): multiply. Then TREE_STAGES stages of adder tree.
+    // Last stage (QUANT only): scale the group sums.
+    reg [DEPTH:0] pipe_valid;
+    reg [DEPTH:0] pipe_row_done;
+
+    integer k;
     always @(posedge clk) begin
         if (rst) begin
-            stage1_valid <= 0;
-            stage1_row_done <= 0;
-            stage1_matrix_element <= 0;
-        end else if (stage0_valid && stage2_ready) begin
-            stage1_row_done <= stage0_row_done;
-            stage1_matrix_element <= stage0_matrix_element;
-            stage1_valid <= 1;
-        end else if (stage2_ready) begin
-            stage1_valid <= 0;
+            pipe_valid <= 0;
+            pipe_row_done <= 0;
+        end else if (advance) begin
+            for (k = DEPTH; k > 0; k = k - 1) begin
+                pipe_valid[k] <= pipe_valid[k-1];
+                pipe_row_done[k] <= pipe_row_done[k-1];
+            end
+            pipe_valid[0] <= s0_valid;
+            pipe_row_done[0] <= s0_row_done;
         end
     end
 
-    // Stage 2: perform multiplication and accumulation.
+    wire output_row = pipe_valid[DEPTH] && pipe_row_done[DEPTH];
+    assign idle = !s0_valid && pipe_valid == 0 && !out_valid;
+
     always @(posedge clk) begin
         if (rst) begin
-            stage2_valid <= 0;
-            acc <= 0;
-        end else if (stage1_valid && out_ready) begin
-            $display("Stage 2: Multiplying matrix element %d with vector element %d", stage1_matrix_element, vec_sram_dout);
-            acc <= acc + stage1_matrix_element * vec_sram_dout;
-            if (stage1_row_done) begin
-                $display("Stage 2: Row done, outputting accumulated value %d", acc);
-                out_data <= acc + stage1_matrix_element * vec_sram_dout;
-                stage2_valid <= 1;
-                acc <= 0;
-            end else begin
-                stage2_valid <= 0;
-            end
-        end else if (out_ready) begin
-            stage2_valid <= 0;
+            out_valid <= 0;
+        end else if (advance) begin
+            out_valid <= output_row;
         end
     end
 
+    // One adder tree and accumulator per row and vector, all fed by the same vector word.
+    genvar u;
+    generate
+        for (u = 0; u < ROWS*BATCH; u = u + 1) begin : unit_gen
+            localparam R = u / BATCH;   // Row within the group
+            localparam B = u % BATCH;   // Vector within the batch
+            // tree holds the registered levels, node the output of every level.
+            /* verilator lint_off UNDRIVEN */
+            /* verilator lint_off UNUSEDSIGNAL */
+            reg [TREE_BITS-1:0] tree;
+            /* verilator lint_on UNUSEDSIGNAL */
+            /* verilator lint_on UNDRIVEN */
+            wire [TREE_BITS-1:0] node;
+            assign node[0 +: LANES*PROD_WIDTH] = tree[0 +: LANES*PROD_WIDTH];
+
+            for (i = 0; i < LANES; i = i + 1) begin : mul_gen
+                // The vector element of this lane, gathered by its index with SPARSE.
+                wire [7:0] x;
+                if (SPARSE) begin : gather
+                    wire [1:0] index = s0_index[(R*LANES + i)*2 +: 2];
+                    assign x = vec_sram_dout[(B*VEC_LANES + (i/2)*4)*8 + index*8 +: 8];
+                end else begin : direct
+                    assign x = vec_sram_dout[(B*LANES + i)*8 +: 8];
+                end
+
+                always @(posedge clk) begin
+                    if (advance) begin
+                        tree[i*PROD_WIDTH +: PROD_WIDTH] <= s0_mask[i]
+                            ? {8'b0, s0_weights[R*ROW_BITS + i*WEIGHT_BITS +: WEIGHT_BITS]}
+                              * {{WEIGHT_BITS{1'b0}}, x}
+                            : {PROD_WIDTH{1'b0}};
+                    end
+                end
+            end
+
+            for (l = 1; l <= LEVELS; l = l + 1) begin : tree_gen
+                localparam W = PROD_WIDTH + l;
+                for (i = 0; i < (LANES >> l); i = i + 1) begin : add_gen
+                    wire [W-1:0] sum = {1'b0, node[tree_offset(l-1) + (2*i)*(W-1) +: W-1]} +
+                                       {1'b0, node[tree_offset(l-1) + (2*i+1)*(W-1) +: W-1]};
+                    if (tree_stage(l) != 0) begin : stage
+                        always @(posedge clk) begin
+                            if (advance) begin
+                                tree[tree_offset(l) + i*W +: W] <= sum;
+                            end
+                        end
+                        assign node[tree_offset(l) + i*W +: W] = tree[tree_offset(l) + i*W +: W];
+                    end else begin : comb
+                        assign node[tree_offset(l) + i*W +: W] = sum;
+                    end
+                end
+            end
+
+            wire [ROOT_WIDTH-1:0] root = node[ROOT_OFFSET +: ROOT_WIDTH];
+            wire [31:0] beat_sum;
+
+            if (QUANT) begin : dequant_gen
+                // The scale travels down the tree alongside its beat.
+                reg [16*(TREE_STAGES+1)-1:0] scale_pipe;
+                always @(posedge clk) begin
+                    if (advance) begin
+                        scale_pipe <= {scale_pipe[0 +: 16*TREE_STAGES], s0_scale[R*16 +: 16]};
+                    end
+                end
+
+                localparam SCALED_WIDTH = ROOT_WIDTH + 16;
+                localparam [SCALED_WIDTH-1:0] ROUND = 1 << (SCALE_SHIFT - 1);
+                wire [SCALED_WIDTH-1:0] product =
+                    {16'b0, root} * {{ROOT_WIDTH{1'b0}}, scale_pipe[16*TREE_STAGES +: 16]} + ROUND;
+                reg [31:0] scaled;
+                always @(posedge clk) begin
+                    if (advance) begin
+                        scaled <= {{(32+SCALE_SHIFT-SCALED_WIDTH){1'b0}}, product[SCALED_WIDTH-1:SCALE_SHIFT]};
+                    end
+                end
+                assign beat_sum = scaled;
+            end else begin : sum_gen
+                assign beat_sum = {{(32-ROOT_WIDTH){1'b0}}, root};
+            end
+
+            // Accumulate the row sum, and output the result at the end of the row.
+            // The masked upper bits of acc are constant, and removed by synthesis.
+            reg [31:0] acc; // Accumulator for the current row.
+            wire [31:0] acc_next = (acc + beat_sum) & ACC_MASK;
+
+            always @(posedge clk) begin
+                if (rst) begin
+                    acc <= 0;
+                end else if (advance && pipe_valid[DEPTH]) begin
+                    if (pipe_row_done[DEPTH]) begin
+`ifdef MATMUL_DEBUG
+                        $display("Row done, outputting accumulated value %d", acc_next);
+`endif
+                        out_data[u*32 +: 32] <= acc_next;
+                        acc <= 0;
+                    end else begin
+                        acc <= acc_next;
+                    end
+                end
+            end
+        end
+    endgenerate
+
+    // Why the core is not accepting a beat every cycle.
+    perf_counters #(
+        .EVENTS(6),
+        .WIDTH(COUNTER_WIDTH),
+        .ADDR_WIDTH(3)
+    ) counters (
+        .clk(clk),
+        .rst(rst),
+        .events({
+            in_fire && !meta_beat,              // 5: vector SRAM reads
+            out_valid && out_ready,             // 4: row groups completed
+            out_valid && !out_ready,            // 3: output backpressure
+            rows_left && advance && !in_valid,  // 2: input starved
+            in_fire,                            // 1: busy
+            1'b1                                // 0: cycles
+        }),
+        .csr_addr(csr_addr),
+        .csr_we(csr_we),
+        .csr_wdata(csr_wdata),
+        .csr_rdata(csr_rdata)
+    );
+
 endmodule
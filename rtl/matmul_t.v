@@ -0,0 +1,221 @@
+// Transposed (vector x matrix) core: y = M^T p, with M streamed row-major.
+//
+// Row t of the matrix (e.g. token t of a V cache) is scaled by element t of
+// the vector p, and added to the output vector, which lives in an SRAM of
+// LANES 32-bit accumulators per word. As in matmul, rows are streamed in
+// beats of LANES elements and start on a beat boundary; lanes beyond hdim in
+// the last beat of a row are ignored. Element t of p is read from the vector
+// SRAM at word t / VEC_LANES, lane t % VEC_LANES (the first vector of a
+// batch), so vdim is at most SRAM depth * VEC_LANES.
+//
+// Every beat reads, adds to, and writes back one accumulator word, one beat
+// per cycle. The first row writes without reading, which clears the output of
+// the previous matrix. A word that is read while it is being written (rows of
+// a single beat) is forwarded from the write.
+//
+// After the last row, the output vector is streamed out, element j in word
+// j / LANES, lane j % LANES, with out_last on the last word. After reset the
+// core accepts one matrix; start (while idle) accepts the next one.
+module matmul_t #(
+    parameter LANES = 32,                       // Matrix elements per beat
+    parameter VEC_LANES = 32,                   // Vector elements per SRAM word
+    parameter VEC_WIDTH = 256,                  // Vector SRAM word
+    parameter SRAM_ADDR_WIDTH = 10,             // Vector SRAM
+    parameter ACC_ADDR_WIDTH = 10,              // Output SRAM, at most ACC_DEPTH * LANES columns
+    parameter ACC_DEPTH = 1024,
+    parameter DIM_WIDTH = 16
+)(
+    input                            clk,
+    input                            rst,
+    input                            start,
+    input  [LANES*8-1:0]             in_data,
+    input                            in_valid,
+    output                           in_ready,
+
+    input  [DIM_WIDTH-1:0]           vdim,
+    input  [DIM_WIDTH-1:0]           hdim,
+
+    output reg [LANES*32-1:0]        out_data,
+    output reg                       out_valid,
+    output reg                       out_last,
+    input                            out_ready,
+
+    // SRAM interface for vector data
+    output [SRAM_ADDR_WIDTH-1:0]     vec_sram_addr,
+    /* verilator lint_off UNUSEDSIGNAL */
+    input  [VEC_WIDTH-1:0]           vec_sram_dout  // Only the first VEC_LANES elements
+    /* verilator lint_on UNUSEDSIGNAL */
+);
+
+    localparam LANE_BITS = $clog2(LANES);
+    localparam VEC_LANE_BITS = $clog2(VEC_LANES);
+    localparam [31:0] LANES_W = LANES;
+
+    // Input is accepted while rows are left; accumulation never stalls.
+    reg rows_left;
+    assign in_ready = rows_left;
+    wire in_fire = in_valid && in_ready;
+
+    // Stage 0: accept a beat, and read its accumulator word and vector element.
+    reg [DIM_WIDTH-1:0] row_idx;
+    reg [ACC_ADDR_WIDTH-1:0] col_idx;           // Beat within the row, and its accumulator word
+    wire [31:0] vdim_w = {{(32-DIM_WIDTH){1'b0}}, vdim};
+    wire [31:0] hdim_w = {{(32-DIM_WIDTH){1'b0}}, hdim};
+    wire [31:0] row_idx_w = {{(32-DIM_WIDTH){1'b0}}, row_idx};
+    wire [31:0] col_idx_w = {{(32-ACC_ADDR_WIDTH){1'b0}}, col_idx};
+    wire [31:0] row_beats = (hdim_w + LANES_W - 32'd1) >> LANE_BITS;
+    wire last_beat = col_idx_w + 32'd1 == row_beats;
+    wire last_row = row_idx_w + 32'd1 >= vdim_w;
+    wire [31:0] col_base = col_idx_w << LANE_BITS;
+    /* verilator lint_off UNUSEDSIGNAL */
+    wire [31:0] vec_word = row_idx_w >> VEC_LANE_BITS;
+    /* verilator lint_on UNUSEDSIGNAL */
+    assign vec_sram_addr = vec_word[SRAM_ADDR_WIDTH-1:0];
+
+    wire [LANES-1:0] lane_mask;
+    genvar l;
+    generate
+        for (l = 0; l < LANES; l = l + 1) begin : mask_gen
+            localparam [31:0] LANE = l;
+            assign lane_mask[l] = col_base + LANE < hdim_w;
+        end
+    endgenerate
+
+    reg s0_valid;
+    reg s0_first;                               // First row: nothing to add to
+    reg s0_last;                                // Last beat of the matrix
+    reg [LANES*8-1:0] s0_weights;
+    reg [LANES-1:0] s0_mask;
+    reg [ACC_ADDR_WIDTH-1:0] s0_col;
+    reg [VEC_LANE_BITS-1:0] s0_lane;
+
+    always @(posedge clk) begin
+        if (rst) begin
+            rows_left <= 1;
+            s0_valid <= 0;
+            s0_last <= 0;
+            row_idx <= 0;
+            col_idx <= 0;
+        end else begin
+            s0_valid <= in_fire;
+            s0_last <= in_fire && last_beat && last_row;
+            if (in_fire) begin
+                s0_first <= row_idx == 0;
+                s0_weights <= in_data;
+                s0_mask <= lane_mask;
+                s0_col <= col_idx;
+                s0_lane <= row_idx_w[VEC_LANE_BITS-1:0];
+                if (last_beat) begin
+                    col_idx <= 0;
+                    row_idx <= row_idx + 1;
+                    if (last_row) begin
+                        rows_left <= 0;  // Stop accepting new input until start
+                    end
+                end else begin
+                    col_idx <= col_idx + 1;
+                end
+            end
+            // Only given while idle, so no beat is accepted in the same cycle.
+            if (start) begin
+                rows_left <= 1;
+                row_idx <= 0;
+                col_idx <= 0;
+            end
+        end
+    end
+
+    // Stage 1: scale the beat by its vector element, add it to the accumulator
+    // word, and write the word back.
+    wire [LANES*32-1:0] acc_dout;
+    wire [LANES*32-1:0] acc_sum;
+    reg fwd_valid;                              // The word written in the last cycle
+    reg [ACC_ADDR_WIDTH-1:0] fwd_col;
+    reg [LANES*32-1:0] fwd_data;
+
+    wire [7:0] p = vec_sram_dout[s0_lane*8 +: 8];
+    wire [LANES*32-1:0] acc_old = s0_first ? {(LANES*32){1'b0}}
+        : fwd_valid && fwd_col == s0_col ? fwd_data
+        : acc_dout;
+
+    genvar i;
+    generate
+        for (i = 0; i < LANES; i = i + 1) begin : mac_gen
+            wire [15:0] product = s0_mask[i] ? {8'b0, s0_weights[i*8 +: 8]} * {8'b0, p} : 16'd0;
+            assign acc_sum[i*32 +: 32] = acc_old[i*32 +: 32] + {16'b0, product};
+        end
+    endgenerate
+
+    always @(posedge clk) begin
+        if (rst) begin
+            fwd_valid <= 0;
+        end else begin
+            fwd_valid <= s0_valid;
+            fwd_col <= s0_col;
+            fwd_data <= acc_sum;
+        end
+    end
+
+    // Output: read the accumulator words in order. The read data is held (by
+    // keeping its address) while the output register is full.
+    reg draining;
+    reg rd_left;
+    reg [ACC_ADDR_WIDTH-1:0] rd_idx;
+    reg [ACC_ADDR_WIDTH-1:0] rd_addr;           // Word of the pending read data
+    reg rd_pending;
+    reg rd_pending_last;
+    wire out_advance = !out_valid || out_ready;
+    wire rd_fire = draining && rd_left && out_advance;
+    wire rd_last = {{(32-ACC_ADDR_WIDTH){1'b0}}, rd_idx} + 32'd1 == row_beats;
+
+    sram_dp #(
+        .DATA_WIDTH(LANES*32),
+        .ADDR_WIDTH(ACC_ADDR_WIDTH),
+        .DEPTH(ACC_DEPTH)
+    ) acc_sram (
+        .clk(clk),
+        .we(s0_valid),
+        .waddr(s0_col),
+        .din(acc_sum),
+        .raddr(!draining ? col_idx : rd_fire ? rd_idx : rd_addr),
+        .dout(acc_dout)
+    );
+
+    always @(posedge clk) begin
+        if (rst) begin
+            draining <= 0;
+            rd_left <= 0;
+            rd_pending <= 0;
+            rd_pending_last <= 0;
+            out_valid <= 0;
+            out_last <= 0;
+        end else begin
+            // Start after the last write, so that the reads see it.
+            if (s0_last) begin
+`ifdef MATMUL_DEBUG
+                $display("Transposed matrix done, outputting %d words", row_beats);
+`endif
+                draining <= 1;
+                rd_left <= 1;
+                rd_idx <= 0;
+            end
+            if (rd_fire) begin
+                rd_addr <= rd_idx;
+                rd_idx <= rd_idx + 1;
+                if (rd_last) begin
+                    rd_left <= 0;
+                end
+            end
+            if (out_advance) begin
+                out_valid <= rd_pending;
+                out_last <= rd_pending_last;
+                out_data <= acc_dout;
+                rd_pending <= rd_fire;
+                rd_pending_last <= rd_fire && rd_last;
+            end
+            if (out_valid && out_ready && out_last) begin
+                draining <= 0;
+            end
+        end
+    end
+
+endmodule
@@ -1,67 +1,413 @@
 module matmul_tb #(
-    parameter MAX_DIM = 16,
+    parameter LANES = 32,
+    parameter ROWS = 1,
+    parameter BATCH = 1,
+    parameter WEIGHT_BITS = 8,
+    parameter SPARSE = 0,
+    parameter DIM_WIDTH = 16,
     parameter SRAM_ADDR_WIDTH = 10,
-    parameter DATA_WIDTH = 8,
-    parameter SRAM_DEPTH = 1024
+    parameter SRAM_DEPTH = 1024,
+    parameter AXI_DATA_WIDTH = 256,
+    parameter DMA_MAX_OUTSTANDING = 8,
+    parameter DMA_FIFO_DEPTH = 64,
+    parameter VEC_DMA_MAX_OUTSTANDING = 2,
+    parameter VEC_DMA_FIFO_DEPTH = 16,
+    parameter RQ_SCALE_ADDR_WIDTH = 12,
+    parameter RQ_SCALE_DEPTH = 4096,
+    parameter T_ACC_ADDR_WIDTH = 10,
+    parameter T_ACC_DEPTH = 1024
 )(
-    input         clk,
-    input         rst,
-    input  [7:0]  in_data,
-    input         in_valid,
-    output        in_ready,
-    
+    input                       clk,
+    input                       rst,
+    input                       start,          // Start the core on the next matrix
+    input  [ROWS*LANES*WEIGHT_BITS-1:0] in_data,
+    input                       in_valid,
+    output                      in_ready,
+
     // Dimension inputs
-    input  [7:0]  vdim,
-    input  [7:0]  hdim,
-
-    output [31:0] out_data,
-    output        out_valid,
-    input         out_ready,
-    
-    // SRAM interface for external control
-    input                       vec_sram_we,
+    input  [DIM_WIDTH-1:0]      vdim,
+    input  [DIM_WIDTH-1:0]      hdim,
+
+    output [ROWS*BATCH*32-1:0]  out_data,
+    output                      out_valid,
+    input                       out_ready,
+
+    // Requantization of the results to int8 (see requant.v). With rq_enable,
+    // the results leave packed through rq_data instead of out_data.
+    input                       rq_enable,
+    input  [31:0]               rq_offset,
+    input  [15:0]               rq_scale,
+    input                       rq_per_row,
+    input  [5:0]                rq_shift,
+    input  [1:0]                rq_act,
+    input                       rq_scale_we,    // Per-row scales, one row group per write
+    input  [RQ_SCALE_ADDR_WIDTH-1:0] rq_scale_addr,
+    input  [ROWS*16-1:0]        rq_scale_din,
+    output [AXI_DATA_WIDTH-1:0] rq_data,
+    output                      rq_valid,
+    output                      rq_last,
+    input                       rq_ready,
+
+    // Transposed mode (see matmul_t.v): with transpose, the matrix goes to the
+    // transposed core, and its result (ROWS*LANES*WEIGHT_BITS/8 32-bit elements
+    // per word) leaves through t_out_data.
+    input                       transpose,
+    output [ROWS*LANES*WEIGHT_BITS*4-1:0] t_out_data,
+    output                      t_out_valid,
+    output                      t_out_last,
+    input                       t_out_ready,
+
+    // Performance counters of the matrix-vector core (see matmul.v)
+    input  [2:0]                csr_addr,
+    input                       csr_we,
+    input  [31:0]               csr_wdata,
+    output [31:0]               csr_rdata,
+
+    // Vector SRAM, double buffered. Writes go to the fill bank, while the core
+    // reads the other one. vec_swap exchanges them (only while the core is idle).
+    input                       vec_swap,
+    input                       vec_sram_we,    // One word (LANES elements, 2*LANES for SPARSE, of BATCH vectors) per write
     input  [SRAM_ADDR_WIDTH-1:0] vec_sram_addr,
-    input  [7:0]                vec_sram_din
+    input  [BATCH*LANES*(SPARSE+1)*8-1:0] vec_sram_din,
+
+    // Vector load from DRAM into the fill bank, starting at word 0
+    input                       vec_dma_start,
+    input  [31:0]               vec_dma_base,
+    input  [31:0]               vec_dma_length,
+    output                      vec_dma_busy,
+
+    // Matrix input from DRAM instead of in_data/in_valid
+    input                       use_dma,
+    input                       dma_start,
+    input  [31:0]               dma_base,
+    input  [31:0]               dma_length,
+    output                      dma_busy,
+    output                      dma_valid,
+    input  [15:0]               dma_max_outstanding,
+    input  [15:0]               dma_fifo_beats,
+
+    // Nothing changes at the next clock edge unless read data arrives, except
+    // the core's performance counters (cycles, and starved while in_ready).
+    // Only in the plain DMA streaming mode. The simulation can skip such cycles.
+    output                      quiet,
+
+    // AXI4 read channels to DRAM
+    output                      m_axi_arvalid,
+    input                       m_axi_arready,
+    output [31:0]               m_axi_araddr,
+    output [7:0]                m_axi_arlen,
+    output [2:0]                m_axi_arsize,
+    output [1:0]                m_axi_arburst,
+    output [3:0]                m_axi_arid,
+    input                       m_axi_rvalid,
+    output                      m_axi_rready,
+    input  [AXI_DATA_WIDTH-1:0] m_axi_rdata,
+    input  [3:0]                m_axi_rid,
+    input                       m_axi_rlast
 );
 
+    localparam VEC_LANES = LANES * (SPARSE + 1); // Vector elements per SRAM word
+    localparam WORD_WIDTH = BATCH * VEC_LANES * 8; // Vector SRAM word
+    localparam BEAT_WIDTH = ROWS * LANES * WEIGHT_BITS; // Matrix beat
+
+    // Matrix stream, either from the DMA or from the testbench, to one of the cores.
+    wire                  dma_out_valid;
+    wire [BEAT_WIDTH-1:0] dma_out_data;
+    wire                  mv_in_ready, t_in_ready;
+    wire                  mm_in_ready = transpose ? t_in_ready : mv_in_ready;
+    wire                  mm_in_valid = use_dma ? dma_out_valid : in_valid;
+    wire [BEAT_WIDTH-1:0] mm_in_data = use_dma ? dma_out_data : in_data;
+    assign in_ready = mm_in_ready;
+    assign dma_valid = dma_out_valid;
+
+    wire                  dma_idle, vec_dma_idle, mm_idle;
+    assign quiet = use_dma && !transpose && !rq_enable && mm_idle && dma_idle && vec_dma_idle
+        && !start && !vec_swap && !vec_sram_we && !rq_scale_we && !csr_we;
+
+    // Both DMAs share the AXI read port: ID 0 for the matrix, ID 1 for the vector.
+    wire                      mat_arvalid, mat_arready, mat_rvalid, mat_rready;
+    wire [31:0]               mat_araddr;
+    wire [7:0]                mat_arlen;
+    wire [2:0]                mat_arsize;
+    wire [1:0]                mat_arburst;
+    wire [3:0]                mat_arid;
+    wire                      vec_arvalid, vec_arready, vec_rvalid, vec_rready;
+    wire [31:0]               vec_araddr;
+    wire [7:0]                vec_arlen;
+    wire [2:0]                vec_arsize;
+    wire [1:0]                vec_arburst;
+    wire [3:0]                vec_arid;
+    wire [AXI_DATA_WIDTH-1:0] rdata;
+    wire                      rlast;
+
+    axi_read_arbiter #(
+        .DATA_WIDTH(AXI_DATA_WIDTH),
+        .M0_ID(0),
+        .M1_ID(1)
+    ) arbiter (
+        .clk(clk),
+        .rst(rst),
+        .m0_arvalid(mat_arvalid),
+        .m0_arready(mat_arready),
+        .m0_araddr(mat_araddr),
+        .m0_arlen(mat_arlen),
+        .m0_arsize(mat_arsize),
+        .m0_arburst(mat_arburst),
+        .m0_arid(mat_arid),
+        .m0_rvalid(mat_rvalid),
+        .m0_rready(mat_rready),
+        .m1_arvalid(vec_arvalid),
+        .m1_arready(vec_arready),
+        .m1_araddr(vec_araddr),
+        .m1_arlen(vec_arlen),
+        .m1_arsize(vec_arsize),
+        .m1_arburst(vec_arburst),
+        .m1_arid(vec_arid),
+        .m1_rvalid(vec_rvalid),
+        .m1_rready(vec_rready),
+        .rdata(rdata),
+        .rlast(rlast),
+        .s_arvalid(m_axi_arvalid),
+        .s_arready(m_axi_arready),
+        .s_araddr(m_axi_araddr),
+        .s_arlen(m_axi_arlen),
+        .s_arsize(m_axi_arsize),
+        .s_arburst(m_axi_arburst),
+        .s_arid(m_axi_arid),
+        .s_rvalid(m_axi_rvalid),
+        .s_rready(m_axi_rready),
+        .s_rdata(m_axi_rdata),
+        .s_rid(m_axi_rid),
+        .s_rlast(m_axi_rlast)
+    );
+
+    axi_dma #(
+        .DATA_WIDTH(AXI_DATA_WIDTH),
+        .OUT_WIDTH(BEAT_WIDTH),
+        .ID(0),
+        .MAX_OUTSTANDING(DMA_MAX_OUTSTANDING),
+        .FIFO_DEPTH(DMA_FIFO_DEPTH)
+    ) dma (
+        .clk(clk),
+        .rst(rst),
+        .start(dma_start),
+        .base(dma_base),
+        .length(dma_length),
+        .busy(dma_busy),
+        .idle(dma_idle),
+        .cfg_max_outstanding(dma_max_outstanding),
+        .cfg_fifo_beats(dma_fifo_beats),
+        .m_axi_arvalid(mat_arvalid),
+        .m_axi_arready(mat_arready),
+        .m_axi_araddr(mat_araddr),
+        .m_axi_arlen(mat_arlen),
+        .m_axi_arsize(mat_arsize),
+        .m_axi_arburst(mat_arburst),
+        .m_axi_arid(mat_arid),
+        .m_axi_rvalid(mat_rvalid),
+        .m_axi_rready(mat_rready),
+        .m_axi_rdata(rdata),
+        .m_axi_rlast(rlast),
+        .out_valid(dma_out_valid),
+        .out_ready(use_dma && mm_in_ready),
+        .out_data(dma_out_data)
+    );
+
+    // Vector DMA, writes one SRAM word per cycle into the fill bank.
+    localparam [15:0] VEC_OUTSTANDING = VEC_DMA_MAX_OUTSTANDING;
+    localparam [15:0] VEC_FIFO_BEATS = VEC_DMA_FIFO_DEPTH;
+    wire                  vec_out_valid;
+    wire                  vec_out_ready = !vec_sram_we; // Writes from the testbench have priority
+    wire [WORD_WIDTH-1:0] vec_out_data;
+    reg  [SRAM_ADDR_WIDTH-1:0] vec_load_addr;
+
+    axi_dma #(
+        .DATA_WIDTH(AXI_DATA_WIDTH),
+        .OUT_WIDTH(WORD_WIDTH),
+        .ID(1),
+        .MAX_OUTSTANDING(VEC_DMA_MAX_OUTSTANDING),
+        .FIFO_DEPTH(VEC_DMA_FIFO_DEPTH)
+    ) vec_dma (
+        .clk(clk),
+        .rst(rst),
+        .start(vec_dma_start),
+        .base(vec_dma_base),
+        .length(vec_dma_length),
+        .busy(vec_dma_busy),
+        .idle(vec_dma_idle),
+        .cfg_max_outstanding(VEC_OUTSTANDING),
+        .cfg_fifo_beats(VEC_FIFO_BEATS),
+        .m_axi_arvalid(vec_arvalid),
+        .m_axi_arready(vec_arready),
+        .m_axi_araddr(vec_araddr),
+        .m_axi_arlen(vec_arlen),
+        .m_axi_arsize(vec_arsize),
+        .m_axi_arburst(vec_arburst),
+        .m_axi_arid(vec_arid),
+        .m_axi_rvalid(vec_rvalid),
+        .m_axi_rready(vec_rready),
+        .m_axi_rdata(rdata),
+        .m_axi_rlast(rlast),
+        .out_valid(vec_out_valid),
+        .out_ready(vec_out_ready),
+        .out_data(vec_out_data)
+    );
+
+    always @(posedge clk) begin
+        if (rst || vec_dma_start) begin
+            vec_load_addr <= 0;
+        end else if (vec_out_valid && vec_out_ready) begin
+            vec_load_addr <= vec_load_addr + 1;
+        end
+    end
+
+    // Bank select: the core reads bank vec_sel, writes go to the other bank.
+    reg vec_sel;
+    always @(posedge clk) begin
+        if (rst) begin
+            vec_sel <= 0;
+        end else if (vec_swap) begin
+            vec_sel <= !vec_sel;
+        end
+    end
+
+    wire                       fill_we = vec_sram_we || (vec_out_valid && vec_out_ready);
+    wire [SRAM_ADDR_WIDTH-1:0] fill_addr = vec_sram_we ? vec_sram_addr : vec_load_addr;
+    wire [WORD_WIDTH-1:0]      fill_din = vec_sram_we ? vec_sram_din : vec_out_data;
+
     // Internal signals for connection between matmul and SRAM
-    wire                        mm_vec_sram_we;
+    /* verilator lint_off UNUSEDSIGNAL */
+    wire                        mm_vec_sram_we; // The core never writes the vector
+    /* verilator lint_on UNUSEDSIGNAL */
     wire [SRAM_ADDR_WIDTH-1:0]  mm_vec_sram_addr;
-    /* verilator lint_off UNDRIVEN */
-    wire [7:0]                  mm_vec_sram_din;
-    wire [7:0]                  vec_sram_dout;
+    wire [WORD_WIDTH-1:0]       bank_dout [0:1];
+    wire [WORD_WIDTH-1:0]       vec_sram_dout = bank_dout[vec_sel];
+
+    // Results, either to out_data or through the requantization stage.
+    wire [ROWS*BATCH*32-1:0]    mm_out_data;
+    wire                        mm_out_valid;
+    wire                        rq_in_ready;
+    wire                        mm_out_ready = rq_enable ? rq_in_ready : out_ready;
+    assign out_data = mm_out_data;
+    assign out_valid = mm_out_valid && !rq_enable;
 
-    // Connect matmul to vector SRAM
     matmul #(
-        .MAX_DIM(MAX_DIM),
-        .SRAM_ADDR_WIDTH(SRAM_ADDR_WIDTH)
+        .SRAM_ADDR_WIDTH(SRAM_ADDR_WIDTH),
+        .LANES(LANES),
+        .ROWS(ROWS),
+        .BATCH(BATCH),
+        .WEIGHT_BITS(WEIGHT_BITS),
+        .SPARSE(SPARSE),
+        .DIM_WIDTH(DIM_WIDTH)
     ) dut (
         .clk(clk),
         .rst(rst),
-        .in_data(in_data),
-        .in_valid(in_valid),
-        .in_ready(in_ready),
+        .start(start),
+        .in_data(mm_in_data),
+        .in_valid(mm_in_valid && !transpose),
+        .in_ready(mv_in_ready),
         .vdim(vdim),
         .hdim(hdim),
-        .out_data(out_data),
-        .out_valid(out_valid),
-        .out_ready(out_ready),
+        .out_data(mm_out_data),
+        .out_valid(mm_out_valid),
+        .out_ready(mm_out_ready),
+        .idle(mm_idle),
         .vec_sram_we(mm_vec_sram_we),
         .vec_sram_addr(mm_vec_sram_addr),
+        .vec_sram_dout(vec_sram_dout),
+        .csr_addr(csr_addr),
+        .csr_we(csr_we),
+        .csr_wdata(csr_wdata),
+        .csr_rdata(csr_rdata)
+    );
+
+    wire [SRAM_ADDR_WIDTH-1:0]  t_vec_sram_addr;
+
+    matmul_t #(
+        .LANES(BEAT_WIDTH / 8),
+        .VEC_LANES(VEC_LANES),
+        .VEC_WIDTH(WORD_WIDTH),
+        .SRAM_ADDR_WIDTH(SRAM_ADDR_WIDTH),
+        .ACC_ADDR_WIDTH(T_ACC_ADDR_WIDTH),
+        .ACC_DEPTH(T_ACC_DEPTH),
+        .DIM_WIDTH(DIM_WIDTH)
+    ) dut_t (
+        .clk(clk),
+        .rst(rst),
+        .start(start),
+        .in_data(mm_in_data),
+        .in_valid(mm_in_valid && transpose),
+        .in_ready(t_in_ready),
+        .vdim(vdim),
+        .hdim(hdim),
+        .out_data(t_out_data),
+        .out_valid(t_out_valid),
+        .out_last(t_out_last),
+        .out_ready(t_out_ready),
+        .vec_sram_addr(t_vec_sram_addr),
         .vec_sram_dout(vec_sram_dout)
     );
-    
-    // Instantiate vector SRAM
+
+    wire [RQ_SCALE_ADDR_WIDTH-1:0] rq_sram_addr;
+    wire [ROWS*16-1:0]          rq_sram_dout;
+
+    requant #(
+        .ROWS(ROWS),
+        .BATCH(BATCH),
+        .DIM_WIDTH(DIM_WIDTH),
+        .SCALE_ADDR_WIDTH(RQ_SCALE_ADDR_WIDTH),
+        .OUT_WIDTH(AXI_DATA_WIDTH)
+    ) rq (
+        .clk(clk),
+        .rst(rst),
+        .in_data(mm_out_data),
+        .in_valid(mm_out_valid && rq_enable),
+        .in_ready(rq_in_ready),
+        .vdim(vdim),
+        .offset(rq_offset),
+        .scale(rq_scale),
+        .per_row(rq_per_row),
+        .shift(rq_shift),
+        .act(rq_act),
+        .scale_addr(rq_sram_addr),
+        .scale_dout(rq_sram_dout),
+        .out_data(rq_data),
+        .out_valid(rq_valid),
+        .out_last(rq_last),
+        .out_ready(rq_ready)
+    );
+
+    // Per-row scales, written only while idle.
     sram #(
-        .DATA_WIDTH(DATA_WIDTH),
-        .ADDR_WIDTH(SRAM_ADDR_WIDTH),
-        .DEPTH(SRAM_DEPTH)
-    ) vec_sram (
+        .DATA_WIDTH(ROWS*16),
+        .ADDR_WIDTH(RQ_SCALE_ADDR_WIDTH),
+        .DEPTH(RQ_SCALE_DEPTH)
+    ) rq_scale_sram (
         .clk(clk),
-        .we(vec_sram_we | mm_vec_sram_we),
-        .addr(vec_sram_we ? vec_sram_addr : mm_vec_sram_addr),
-        .din(vec_sram_we ? vec_sram_din : mm_vec_sram_din),
-        .dout(vec_sram_dout)
+        .we(rq_scale_we),
+        .addr(rq_scale_we ? rq_scale_addr : rq_sram_addr),
+        .din(rq_scale_din),
+        .dout(rq_sram_dout)
     );
 
+    // Instantiate the two vector SRAM banks
+    genvar b;
+    generate
+        for (b = 0; b < 2; b = b + 1) begin : bank_gen
+            localparam [0:0] BANK = b;
+            wire compute = vec_sel == BANK;
+            sram #(
+                .DATA_WIDTH(WORD_WIDTH),
+                .ADDR_WIDTH(SRAM_ADDR_WIDTH),
+                .DEPTH(SRAM_DEPTH)
+            ) vec_sram (
+                .clk(clk),
+                .we(!compute && fill_we),
+                .addr(!compute ? fill_addr : transpose ? t_vec_sram_addr : mm_vec_sram_addr),
+                .din(fill_din),
+                .dout(bank_dout[b])
+            );
+        end
+    endgenerate
+
 endmodule
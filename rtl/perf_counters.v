@@ -0,0 +1,68 @@
+// Performance counters: one free-running counter per event, counting the
+// cycles in which the event bit is set. The counters wrap at 2^WIDTH.
+//
+// Register map (csr_addr):
+//   0 .. EVENTS-1   counter n; a write sets it to csr_wdata, e.g. 0 to clear it
+//   CTRL (all ones) bit 0: enable (set after reset), counters hold while clear
+//                   bit 1: write 1 to clear all counters (reads as 0)
+// Reads are registered like an SRAM: csr_rdata holds the register addressed in
+// the cycle before. A write takes precedence over an event in the same cycle.
+module perf_counters #(
+    parameter EVENTS = 6,
+    parameter WIDTH = 32,
+    parameter ADDR_WIDTH = 3                    // EVENTS < 2^ADDR_WIDTH
+)(
+    input                            clk,
+    input                            rst,
+    input  [EVENTS-1:0]              events,
+
+    input  [ADDR_WIDTH-1:0]          csr_addr,
+    input                            csr_we,
+    input  [WIDTH-1:0]               csr_wdata,
+    output reg [WIDTH-1:0]           csr_rdata
+);
+
+    localparam [ADDR_WIDTH-1:0] CTRL = {ADDR_WIDTH{1'b1}};
+    localparam [ADDR_WIDTH-1:0] LAST = EVENTS - 1;
+
+    reg enable;
+    reg [EVENTS*WIDTH-1:0] counters;            // Counter n in bits [n*WIDTH +: WIDTH]
+    wire ctrl_write = csr_we && csr_addr == CTRL;
+    wire clear = ctrl_write && csr_wdata[1];
+    wire [31:0] csr_addr_w = {{(32-ADDR_WIDTH){1'b0}}, csr_addr};
+
+    always @(posedge clk) begin
+        if (rst) begin
+            enable <= 1;
+        end else if (ctrl_write) begin
+            enable <= csr_wdata[0];
+        end
+    end
+
+    genvar e;
+    generate
+        for (e = 0; e < EVENTS; e = e + 1) begin : counter_gen
+            localparam [ADDR_WIDTH-1:0] ADDR = e;
+            always @(posedge clk) begin
+                if (rst || clear) begin
+                    counters[e*WIDTH +: WIDTH] <= 0;
+                end else if (csr_we && csr_addr == ADDR) begin
+                    counters[e*WIDTH +: WIDTH] <= csr_wdata;
+                end else if (enable && events[e]) begin
+                    counters[e*WIDTH +: WIDTH] <= counters[e*WIDTH +: WIDTH] + 1;
+                end
+            end
+        end
+    endgenerate
+
+    always @(posedge clk) begin
+        if (csr_addr == CTRL) begin
+            csr_rdata <= {{(WIDTH-1){1'b0}}, enable};
+        end else if (csr_addr <= LAST) begin
+            csr_rdata <= counters[csr_addr_w*WIDTH +: WIDTH];
+        end else begin
+            csr_rdata <= 0;
+        end
+    end
+
+endmodule
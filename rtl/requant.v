@@ -0,0 +1,180 @@
+// Output requantization: turns the 32-bit row sums of the core into int8.
+//
+// Each result x becomes
+//     y = sat8(act(sat16(((x - offset) * scale + 2^(shift-1)) >>> shift)))
+// with one scale for the whole matrix, or with per_row a scale per row from
+// the scale SRAM: word n holds the scales of row group n (row r of the group
+// in bits [r*16 +: 16]). Rounding is half up. The activation is
+//   act = 0: none
+//   act = 1: ReLU
+//   act = 2: SiLU, approximated as y * clamp(y/4 + 1/2, 0, 1) (a hard sigmoid
+//            with the slope of the sigmoid at 0), in fixed point with
+//            ACT_FRAC_BITS fraction bits.
+//
+// The int8 results are packed in input order (VALUES results per input, then
+// the next input) into OUT_WIDTH-bit beats, lowest byte first. For BATCH = 1
+// that is the order of the rows, i.e. the vector SRAM layout of the next
+// layer. out_last marks the last beat of the matrix, which is zero padded.
+// VALUES must divide OUT_WIDTH / 8.
+//
+// The whole pipeline stalls while a beat waits at the output.
+module requant #(
+    parameter ROWS = 1,                         // Rows per input
+    parameter BATCH = 1,                        // Results per row
+    parameter DIM_WIDTH = 16,
+    parameter SCALE_ADDR_WIDTH = 12,
+    parameter OUT_WIDTH = 256,
+    parameter ACT_FRAC_BITS = 4
+)(
+    input                            clk,
+    input                            rst,
+    input  [ROWS*BATCH*32-1:0]       in_data,
+    input                            in_valid,
+    output                           in_ready,
+    input  [DIM_WIDTH-1:0]           vdim,
+
+    // Configuration, held during a matrix
+    input  [31:0]                    offset,
+    input  [15:0]                    scale,
+    input                            per_row,
+    input  [5:0]                     shift,
+    input  [1:0]                     act,
+
+    // Scale SRAM, registered output
+    output [SCALE_ADDR_WIDTH-1:0]    scale_addr,
+    input  [ROWS*16-1:0]             scale_dout,
+
+    output reg [OUT_WIDTH-1:0]       out_data,
+    output reg                       out_valid,
+    output reg                       out_last,
+    input                            out_ready
+);
+
+    localparam VALUES = ROWS * BATCH;
+    localparam GROUPS = OUT_WIDTH / 8 / VALUES; // Inputs per output beat
+    localparam [7:0] FILL_LAST = GROUPS - 1;
+    localparam [31:0] ROWS_W = ROWS;
+    localparam [1:0] ACT_RELU = 1;
+    localparam [1:0] ACT_SILU = 2;
+    localparam signed [31:0] ONE = 1 << ACT_FRAC_BITS;
+
+    wire advance = !out_valid || out_ready;
+    assign in_ready = advance;
+    wire in_fire = in_valid && in_ready;
+
+    // Stage 0: accept the results of a row group, and fetch their scales.
+    reg [DIM_WIDTH-1:0] row_idx;                // First row of the incoming group
+    reg [SCALE_ADDR_WIDTH-1:0] group_idx;
+    wire last_group = {{(32-DIM_WIDTH){1'b0}}, row_idx} + ROWS_W >= {{(32-DIM_WIDTH){1'b0}}, vdim};
+
+    reg s0_valid;
+    reg s0_last;
+    reg [VALUES*32-1:0] s0_data;
+    reg [SCALE_ADDR_WIDTH-1:0] s0_addr;
+
+    assign scale_addr = in_fire ? group_idx : s0_addr;
+
+    always @(posedge clk) begin
+        if (rst) begin
+            s0_valid <= 0;
+            s0_last <= 0;
+            s0_addr <= 0;
+            row_idx <= 0;
+            group_idx <= 0;
+        end else if (advance) begin
+            s0_valid <= in_fire;
+            if (in_fire) begin
+                s0_data <= in_data;
+                s0_last <= last_group;
+                s0_addr <= group_idx;
+                // The next matrix starts after the last group.
+                if (last_group) begin
+                    row_idx <= 0;
+                    group_idx <= 0;
+                end else begin
+                    row_idx <= row_idx + ROWS_W[DIM_WIDTH-1:0];
+                    group_idx <= group_idx + 1;
+                end
+            end
+        end
+    end
+
+    // Stage 1: subtract the offset and scale. Stage 2: round, activate, saturate, and pack.
+    reg s1_valid;
+    reg s1_last;
+    reg [7:0] fill;                             // Inputs in the beat being packed
+    reg [OUT_WIDTH-1:0] beat;
+    wire [OUT_WIDTH-1:0] next_beat;
+    wire [VALUES*8-1:0] bytes;
+
+    wire signed [49:0] round = shift == 6'd0 ? 50'sd0 : 50'sd1 <<< (shift - 6'd1);
+
+    genvar v, g;
+    generate
+        for (v = 0; v < VALUES; v = v + 1) begin : value_gen
+            localparam R = v / BATCH;
+            wire [15:0] value_scale = per_row ? scale_dout[R*16 +: 16] : scale;
+            wire signed [32:0] diff = $signed({1'b0, s0_data[v*32 +: 32]}) - $signed({1'b0, offset});
+            reg signed [49:0] scaled;
+            always @(posedge clk) begin
+                if (advance) begin
+                    // The low 50 bits of the product are the same signed or unsigned.
+                    scaled <= {{17{diff[32]}}, diff} * {34'b0, value_scale};
+                end
+            end
+
+            wire signed [49:0] rounded = (scaled + round) >>> shift;
+            wire signed [15:0] y = rounded > 50'sd32767 ? 16'sh7fff
+                : rounded < -50'sd32768 ? 16'sh8000
+                : rounded[15:0];
+
+            wire signed [31:0] y_w = {{16{y[15]}}, y};
+            wire signed [31:0] sig_raw = (y_w >>> 2) + ONE / 2;
+            wire signed [31:0] sig = sig_raw < 32'sd0 ? 32'sd0 : sig_raw > ONE ? ONE : sig_raw;
+            /* verilator lint_off UNUSEDSIGNAL */
+            wire signed [31:0] silu = (y_w * sig) >>> ACT_FRAC_BITS;
+            /* verilator lint_on UNUSEDSIGNAL */
+            wire signed [15:0] a = act == ACT_RELU ? (y < 16'sd0 ? 16'sd0 : y)
+                : act == ACT_SILU ? silu[15:0]
+                : y;
+
+            assign bytes[v*8 +: 8] = a > 16'sd127 ? 8'h7f : a < -16'sd128 ? 8'h80 : a[7:0];
+        end
+
+        for (g = 0; g < GROUPS; g = g + 1) begin : pack_gen
+            localparam [7:0] G = g;
+            assign next_beat[g*VALUES*8 +: VALUES*8] = fill == G ? bytes : beat[g*VALUES*8 +: VALUES*8];
+        end
+    endgenerate
+
+    always @(posedge clk) begin
+        if (rst) begin
+            s1_valid <= 0;
+            s1_last <= 0;
+            fill <= 0;
+            beat <= 0;
+            out_valid <= 0;
+            out_last <= 0;
+        end else if (advance) begin
+            s1_valid <= s0_valid;
+            s1_last <= s0_last;
+            out_valid <= 0;
+            if (s1_valid) begin
+                if (s1_last || fill == FILL_LAST) begin
+`ifdef MATMUL_DEBUG
+                    $display("Requant beat done, last=%d", s1_last);
+`endif
+                    out_data <= next_beat;
+                    out_valid <= 1;
+                    out_last <= s1_last;
+                    fill <= 0;
+                    beat <= 0;
+                end else begin
+                    beat <= next_beat;
+                    fill <= fill + 1;
+                end
+            end
+        end
+    end
+
+endmodule
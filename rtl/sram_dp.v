@@ -0,0 +1,22 @@
+// Simple dual port SRAM for testing: one write and one read port, 1 cycle
+// read. A read of the address written in the same cycle returns the old data.
+module sram_dp #(
+    parameter DATA_WIDTH = 8,
+    parameter ADDR_WIDTH = 10,
+    parameter DEPTH = 1024
+)(
+    input wire clk,
+    input wire we,
+    input wire [ADDR_WIDTH-1:0] waddr,
+    input wire [DATA_WIDTH-1:0] din,
+    input wire [ADDR_WIDTH-1:0] raddr,
+    output reg [DATA_WIDTH-1:0] dout
+);
+    reg [DATA_WIDTH-1:0] mem [0:DEPTH-1];
+
+    always @(posedge clk) begin
+        if (we)
+            mem[waddr] <= din;
+        dout <= mem[raddr];
+    end
+endmodule
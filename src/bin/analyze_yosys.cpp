@@ -4,10 +4,17 @@ It will estimate the cost of a complete PCIE board design at different process n
 including ASIC, DRAM controller, packaging, PCB, and RAM chips.
 */
 
+#include <algorithm>
+#include <atomic>
 #include <cmath>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/stat.h>
 
 // PCIE board component parameters
 const double RAM_CAPACITY_GB = 4.0;       // Total RAM capacity in GB
@@ -16,6 +23,10 @@ const double MEMORY_BANDWIDTH_GB_S = 50.0; // Memory bandwidth in GB/s
 const double PCB_BASE_COST = 30.0;         // Base PCB cost in USD
 const double PACKAGING_BASE_COST = 10.0;   // Base packaging cost in USD
 
+const double TARGET_GMAC = 40.0;           // Performance the board must reach
+const double COST_PER_UM2_45NM = 0.0000035; // USD per µm² of die at 45nm
+const double SRAM_UM2_PER_BIT = 0.75;      // 45nm SRAM macro area per bit, including periphery
+
 // Function to calculate system costs for a given node size
 double calculate_system_cost(double area, double freq_ghz, double macs_per_cycle, 
                            double node_size, double target_gmac, 
@@ -56,27 +67,653 @@ double calculate_system_cost(double area, double freq_ghz, double macs_per_cycle
     return total_cost;
 }
 
-int main() {
-    char line[1024];
+// Synthesis results of a log. ABC maps each module separately, so the totals are summed over
+// the modules (each instantiated once), and the delay is that of the slowest module.
+typedef struct Synthesis {
     double gates = 0, area = 0, delay_ps = 0;
+} Synthesis;
+
+// Parse one line of the yosys log: ABC's summary line of a module.
+static void parse_abc(const char *line, Synthesis *s) {
+    if (strstr(line, "ABC:") && strstr(line, "Gates") && strstr(line, "Area") && strstr(line, "Delay")) {
+        double gates = 0, area = 0, delay_ps = 0;
+        sscanf(line,
+            "ABC: WireLoad = \"none\" Gates = %lf %*[^A]Area = %lf %*[^D]Delay = %lf",
+            &gates, &area, &delay_ps);
+        s->gates += gates;
+        s->area += area;
+        s->delay_ps = fmax(s->delay_ps, delay_ps);
+    }
+}
+
+// Area and flip-flops of a `stat -liberty` report. Totals are taken from the design hierarchy
+// section if there is one, else summed over the modules (each instantiated once). Flip-flops
+// are the Nangate cells dfflibmap maps to (DFF_X1, DFFR_X1, ...); yosys' own $_DFF_* and
+// $_SDFF*_ cells have no area in the library, so they are counted apart as unmapped.
+typedef struct CellStats {
+    double top_area = 0, module_area = 0;
+    double counters_area = 0;       // Performance counters (perf_counters.v)
+    int flip_flops = 0;
+    int unmapped_flip_flops = 0;
+    bool in_hierarchy = false;
+} CellStats;
+
+static void parse_stat(const char *line, CellStats *s) {
+    double area;
+    char name[256];
+    if (strncmp(line, "=== ", 4) == 0) {
+        s->in_hierarchy = strstr(line, "design hierarchy") != NULL;
+    }
+    if (sscanf(line, " Chip area for top module %*s %lf", &area) == 1) {
+        s->top_area = area;
+    } else if (sscanf(line, " Chip area for module %255s %lf", name, &area) == 2) {
+        s->module_area += area;
+        if (strstr(name, "perf_counters")) {
+            s->counters_area += area;
+        }
+    }
+    // Cell lines are "name count", or "count area name" in newer versions.
+    double count, cell_area;
+    if (s->in_hierarchy) {
+        return;
+    }
+    if (sscanf(line, " %255s %lf", name, &count) != 2 &&
+        sscanf(line, " %lf %lf %255s", &count, &cell_area, name) != 3) {
+        return;
+    }
+    if (strncmp(name, "DFF", 3) == 0 || strncmp(name, "SDFF", 4) == 0) {
+        s->flip_flops += (int)count;
+    } else if (strncmp(name, "$_DFF", 5) == 0 || strncmp(name, "$_SDFF", 6) == 0) {
+        s->unmapped_flip_flops += (int)count;
+    }
+}
+
+// Logic area of a stat report, 0 if the log has none.
+static double stat_area(const CellStats &s) {
+    return s.top_area > 0 ? s.top_area : s.module_area;
+}
+
+// A point of the design space, and what synthesis made of it.
+typedef struct SweepPoint {
+    int lanes, acc_width, tree_levels_per_stage, sram_depth;
+    bool ok = false;
+    Synthesis synth;
+    CellStats cells;
+    double logic_area = 0, sram_area = 0, area = 0;     // µm²
+    double freq_ghz = 0, gmac = 0;
+    double cost = 0, cost_per_gmac = 0, gmac_per_mm2 = 0;
+    bool wraps = false;     // Rows of the required length can wrap the accumulator
+    bool pareto = false;
+
+    std::string name() const {
+        char buf[128];
+        snprintf(buf, sizeof(buf), "l%d_a%d_t%d_d%d", lanes, acc_width, tree_levels_per_stage, sram_depth);
+        return buf;
+    }
+
+    // Longest row whose 8-bit sum can't wrap the accumulator. The runtime only tiles rows to
+    // fit the SRAM, so longer rows give wrong results.
+    double acc_cols() const {
+        return floor((pow(2.0, acc_width) - 1) / (255.0 * 255.0));
+    }
+
+    // Longest row that runs as one tile: without wrapping, and fitting the SRAM.
+    double max_cols() const {
+        return std::min(acc_cols(), (double)sram_depth * lanes);
+    }
+} SweepPoint;
+
+// The synthesis script of make asic, with the hierarchy line set to the parameters of p: the
+// -chparam options of the point replace those of the script. Empty if there is no hierarchy line.
+static std::string point_script(const std::string &script, const SweepPoint &p) {
+    const char *names[] = {"LANES", "ACC_WIDTH", "TREE_LEVELS_PER_STAGE", "SRAM_ADDR_WIDTH"};
+    const int values[] = {p.lanes, p.acc_width, p.tree_levels_per_stage, (int)ceil(log2(p.sram_depth))};
+    std::string out;
+    bool found = false;
+    size_t begin = 0;
+    while (begin < script.size()) {
+        size_t end = script.find('\n', begin);
+        end = end == std::string::npos ? script.size() : end + 1;
+        std::string line = script.substr(begin, end - begin);
+        begin = end;
+        if (line.compare(0, 10, "hierarchy ") != 0) {
+            out += line;
+            continue;
+        }
+        found = true;
+        std::vector<std::string> words;
+        char word[256];
+        int n;
+        for (const char *q = line.c_str(); sscanf(q, " %255s%n", word, &n) == 1; q += n) {
+            words.push_back(word);
+        }
+        line.clear();
+        for (size_t i = 0; i < words.size(); i++) {
+            bool replaced = false;
+            for (const char *name : names) {
+                replaced = replaced || (words[i] == "-chparam" && i + 1 < words.size() && words[i + 1] == name);
+            }
+            if (replaced) {
+                i += 2;
+            } else {
+                line += (line.empty() ? "" : " ") + words[i];
+            }
+        }
+        for (size_t i = 0; i < 4; i++) {
+            line += " -chparam " + std::string(names[i]) + " " + std::to_string(values[i]);
+        }
+        out += line + "\n";
+    }
+    return found ? out : std::string();
+}
+
+// Synthesize one point with script (see point_script) into obj_dir/sweep/<name>.log, and parse it.
+static void synthesize(SweepPoint *p, const std::string &script) {
+    std::string base = "obj_dir/sweep/" + p->name();
+    FILE *f = fopen((base + ".ys").c_str(), "w");
+    if (!f) {
+        perror((base + ".ys").c_str());
+        return;
+    }
+    fputs(point_script(script, *p).c_str(), f);
+    fclose(f);
+    std::string command = "yosys -s " + base + ".ys > " + base + ".log 2>&1";
+    if (system(command.c_str()) != 0) {
+        fprintf(stderr, "%s failed, see %s.log\n", p->name().c_str(), base.c_str());
+        return;
+    }
+    f = fopen((base + ".log").c_str(), "r");
+    if (!f) {
+        perror((base + ".log").c_str());
+        return;
+    }
+    char line[1024];
+    while (fgets(line, sizeof(line), f)) {
+        parse_abc(line, &p->synth);
+        parse_stat(line, &p->cells);
+    }
+    fclose(f);
+    p->logic_area = stat_area(p->cells);
+    if (p->logic_area == 0) {
+        p->logic_area = p->synth.area;
+    }
+    p->ok = p->logic_area > 0 && p->synth.delay_ps > 0;
+    if (!p->ok) {
+        fprintf(stderr, "%s: failed to parse %s.log\n", p->name().c_str(), base.c_str());
+    } else if (p->cells.unmapped_flip_flops > 0) {
+        fprintf(stderr, "%s: %d flip-flops not mapped to library cells, their area is missing\n",
+                p->name().c_str(), p->cells.unmapped_flip_flops);
+    }
+}
+
+// Parse "NAME=v1,v2,..." into values; returns false if it isn't one.
+static bool parse_axis(const char *arg, const char *name, std::vector<int> *values) {
+    size_t n = strlen(name);
+    if (strncmp(arg, name, n) != 0 || arg[n] != '=') {
+        return false;
+    }
+    values->clear();
+    for (const char *p = arg + n + 1; *p;) {
+        char *end;
+        long v = strtol(p, &end, 0);
+        if (end == p || v <= 0) {
+            fprintf(stderr, "Invalid value in %s\n", arg);
+            exit(1);
+        }
+        values->push_back((int)v);
+        p = *end == ',' ? end + 1 : end;
+    }
+    return true;
+}
+
+static const char *SWEEP_USAGE =
+    "Usage: analyze_yosys sweep [jobs] [LANES=..] [ACC_WIDTH=..] [TREE_LEVELS_PER_STAGE=..] [SRAM_DEPTH=..]\n"
+    "                           [MIN_COLS=n] [csv=path]\n";
+
+/*
+Synthesizes every combination of the listed values (comma separated) as parallel yosys jobs,
+with the script of make asic (yosys/synth.ys), and prints each point's cost for the target
+performance, and the Pareto front of $/GMAC against GMAC/mm². Points whose accumulator can wrap
+on rows of MIN_COLS columns (default 4096, the smallest LLM hidden size) are left off the front.
+The vector SRAM (two banks) is estimated, not synthesized. See SWEEP_USAGE.
+*/
+static int sweep(int argc, char **argv) {
+    unsigned jobs = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<int> lanes = {16, 32, 64}, acc_widths = {24, 32}, stages = {1, 2, 3}, depths = {512, 1024, 2048};
+    std::vector<int> min_cols = {4096};
+    const char *csv_path = "obj_dir/sweep.csv";
+    for (int i = 0; i < argc; i++) {
+        if (parse_axis(argv[i], "LANES", &lanes) || parse_axis(argv[i], "ACC_WIDTH", &acc_widths) ||
+            parse_axis(argv[i], "TREE_LEVELS_PER_STAGE", &stages) || parse_axis(argv[i], "SRAM_DEPTH", &depths) ||
+            parse_axis(argv[i], "MIN_COLS", &min_cols)) {
+            continue;
+        }
+        char *end;
+        unsigned long n = strtoul(argv[i], &end, 0);
+        if (i == 0 && n > 0 && *end == '\0') {
+            jobs = (unsigned)std::min(n, 1024ul);
+        } else if (strncmp(argv[i], "csv=", 4) == 0 && argv[i][4]) {
+            csv_path = argv[i] + 4;
+        } else {
+            fprintf(stderr, "Unknown argument %s\n%s", argv[i], SWEEP_USAGE);
+            return 1;
+        }
+    }
+    if (min_cols.size() != 1) {
+        fprintf(stderr, "MIN_COLS takes one value\n");
+        return 1;
+    }
+    for (int acc : acc_widths) {
+        if (acc > 32) {
+            fprintf(stderr, "ACC_WIDTH is at most 32\n");
+            return 1;
+        }
+    }
+
+    std::vector<SweepPoint> points;
+    for (int l : lanes) {
+        for (int a : acc_widths) {
+            for (int t : stages) {
+                for (int d : depths) {
+                    SweepPoint p;
+                    p.lanes = l;
+                    p.acc_width = a;
+                    p.tree_levels_per_stage = t;
+                    p.sram_depth = d;
+                    points.push_back(p);
+                }
+            }
+        }
+    }
+    std::string script;
+    FILE *f = fopen("yosys/synth.ys", "r");
+    if (!f) {
+        perror("yosys/synth.ys");
+        return 1;
+    }
+    char buffer[4096];
+    for (size_t n; (n = fread(buffer, 1, sizeof(buffer), f)) > 0;) {
+        script.append(buffer, n);
+    }
+    fclose(f);
+    if (point_script(script, points[0]).empty()) {
+        fprintf(stderr, "yosys/synth.ys: no hierarchy command\n");
+        return 1;
+    }
+
+    mkdir("obj_dir", 0755);
+    mkdir("obj_dir/sweep", 0755);
+    printf("Synthesizing %zu points with %u jobs...\n", points.size(), jobs);
+    std::atomic<size_t> next(0);
+    std::vector<std::thread> pool;
+    for (unsigned j = 0; j < std::min<size_t>(jobs, points.size()); j++) {
+        pool.emplace_back([&]() {
+            for (size_t i; (i = next++) < points.size();) {
+                synthesize(&points[i], script);
+            }
+        });
+    }
+    for (std::thread &t : pool) {
+        t.join();
+    }
+
+    std::vector<SweepPoint *> done;
+    for (SweepPoint &p : points) {
+        if (!p.ok) {
+            continue;
+        }
+        p.sram_area = 2.0 * p.sram_depth * p.lanes * 8 * SRAM_UM2_PER_BIT;
+        p.area = p.logic_area + p.sram_area;
+        p.freq_ghz = 1000.0 / p.synth.delay_ps;
+        p.gmac = p.lanes * p.freq_ghz;
+        p.cost = calculate_system_cost(p.area, p.freq_ghz, p.lanes, 45.0, TARGET_GMAC, COST_PER_UM2_45NM, false);
+        p.cost_per_gmac = p.cost / TARGET_GMAC;
+        p.gmac_per_mm2 = p.gmac / (p.area / 1e6);
+        p.wraps = p.acc_cols() < min_cols[0];
+        done.push_back(&p);
+    }
+    if (done.empty()) {
+        fprintf(stderr, "Error: no point was synthesized.\n");
+        return 1;
+    }
+    // On the front if it doesn't wrap, and no other such point is at least as good in both, and
+    // better in one.
+    for (SweepPoint *p : done) {
+        p->pareto = !p->wraps;
+        for (SweepPoint *q : done) {
+            if (p->pareto && !q->wraps && q->cost_per_gmac <= p->cost_per_gmac && q->gmac_per_mm2 >= p->gmac_per_mm2 &&
+                (q->cost_per_gmac < p->cost_per_gmac || q->gmac_per_mm2 > p->gmac_per_mm2)) {
+                p->pareto = false;
+                break;
+            }
+        }
+    }
+    std::sort(done.begin(), done.end(),
+              [](const SweepPoint *a, const SweepPoint *b) { return a->cost_per_gmac < b->cost_per_gmac; });
+
+    FILE *csv = fopen(csv_path, "w");
+    if (!csv) {
+        perror(csv_path);
+        return 1;
+    }
+    fprintf(csv, "lanes,acc_width,tree_levels_per_stage,sram_depth,logic_area_um2,sram_area_um2,flip_flops,"
+                 "delay_ps,freq_ghz,gmac,max_cols,wraps,system_cost,cost_per_gmac,gmac_per_mm2,pareto\n");
+    printf("\n=== Design space (45nm, %.0f GMAC board) ===\n", TARGET_GMAC);
+    printf("Lanes\tAcc\tLevels\tDepth\tLogic µm²\tSRAM µm²\tFFs\tGHz\tGMAC\tMax cols\t$/GMAC\tGMAC/mm²\n");
+    for (const SweepPoint *p : done) {
+        fprintf(csv, "%d,%d,%d,%d,%.2f,%.2f,%d,%.1f,%.4f,%.4f,%.0f,%d,%.4f,%.6f,%.4f,%d\n", p->lanes,
+                p->acc_width, p->tree_levels_per_stage, p->sram_depth, p->logic_area, p->sram_area,
+                p->cells.flip_flops, p->synth.delay_ps, p->freq_ghz, p->gmac, p->max_cols(), p->wraps, p->cost,
+                p->cost_per_gmac, p->gmac_per_mm2, p->pareto);
+        printf("%d\t%d\t%d\t%d\t%.0f\t\t%.0f\t\t%d\t%.2f\t%.1f\t%.0f\t\t%.4f\t%.1f%s\n", p->lanes, p->acc_width,
+               p->tree_levels_per_stage, p->sram_depth, p->logic_area, p->sram_area, p->cells.flip_flops,
+               p->freq_ghz, p->gmac, p->max_cols(), p->cost_per_gmac, p->gmac_per_mm2,
+               p->pareto ? "\t*" : p->wraps ? "\twraps" : "");
+    }
+    fclose(csv);
+
+    printf("\n=== Pareto front ($/GMAC vs GMAC/mm², rows of %d columns without wrapping) ===\n", min_cols[0]);
+    for (const SweepPoint *p : done) {
+        if (p->pareto) {
+            printf("   LANES=%d ACC_WIDTH=%d TREE_LEVELS_PER_STAGE=%d SRAM_DEPTH=%d: $%.4f/GMAC, %.1f GMAC/mm²\n",
+                   p->lanes, p->acc_width, p->tree_levels_per_stage, p->sram_depth, p->cost_per_gmac,
+                   p->gmac_per_mm2);
+        }
+    }
+    printf("\nWrote %s (%zu of %zu points synthesized)\n", csv_path, done.size(), points.size());
+    return done.size() == points.size() ? 0 : 1;
+}
+
+// One kind of weight matrix of a model: rows x cols, used count times per token.
+typedef struct ModelLayer {
+    char name[32];
+    double rows, cols, count;
+} ModelLayer;
+
+// Weight matrices, and the attention over the KV cache: per token and layer, scores and
+// weighted sum each take context x kv_width MACs over an 8-bit cache.
+typedef struct Model {
+    char name[64] = "";
+    std::vector<ModelLayer> layers;
+    double kv_width = 0, kv_layers = 0;
+} Model;
+
+static const Model model_presets[] = {
+    {"7B", {{"qkv", 12288, 4096, 32}, {"o", 4096, 4096, 32}, {"ffn_up", 22016, 4096, 32},
+            {"ffn_down", 4096, 11008, 32}, {"lm_head", 32000, 4096, 1}}, 4096, 32},
+    {"13B", {{"qkv", 15360, 5120, 40}, {"o", 5120, 5120, 40}, {"ffn_up", 27648, 5120, 40},
+             {"ffn_down", 5120, 13824, 40}, {"lm_head", 32000, 5120, 1}}, 5120, 40},
+};
+
+/*
+A preset name, or a file with one entry per line ('#' starts a comment):
+    layer <name> <rows> <cols> <count per token>
+    attention <kv width> <layers>
+*/
+static bool load_model(const char *spec, Model *m) {
+    for (const Model &preset : model_presets) {
+        if (!strcmp(spec, preset.name)) {
+            *m = preset;
+            return true;
+        }
+    }
+    FILE *f = fopen(spec, "r");
+    if (!f) {
+        perror(spec);
+        return false;
+    }
+    const char *base = strrchr(spec, '/');
+    snprintf(m->name, sizeof(m->name), "%s", base ? base + 1 : spec);
+    char line[256];
+    int number = 0;
+    while (fgets(line, sizeof(line), f)) {
+        number++;
+        char *comment = strchr(line, '#');
+        if (comment) {
+            *comment = '\0';
+        }
+        ModelLayer layer;
+        char word[32];
+        if (sscanf(line, " %31s", word) != 1) {
+            continue;
+        }
+        if (sscanf(line, " layer %31s %lf %lf %lf", layer.name, &layer.rows, &layer.cols, &layer.count) == 4) {
+            m->layers.push_back(layer);
+        } else if (sscanf(line, " attention %lf %lf", &m->kv_width, &m->kv_layers) != 2) {
+            fprintf(stderr, "%s:%d: expected 'layer name rows cols count' or 'attention width layers'\n", spec,
+                    number);
+            fclose(f);
+            return false;
+        }
+    }
+    fclose(f);
+    if (m->layers.empty()) {
+        fprintf(stderr, "%s: no layers\n", spec);
+        return false;
+    }
+    return true;
+}
+
+// MACs and DRAM bytes of one pass, and its time on the roofline.
+typedef struct Work {
+    double macs = 0, bytes = 0;
+
+    double seconds(double peak_mac_s, double bytes_s) const {
+        return fmax(macs / peak_mac_s, bytes / bytes_s);
+    }
+    bool compute_bound(double peak_mac_s, double bytes_s) const {
+        return macs / peak_mac_s > bytes / bytes_s;
+    }
+} Work;
+
+typedef struct Projection {
+    int weight_bits, batch, context;
+    int core_batch;                 // Vectors the core multiplies with each weight beat (BATCH)
+    double bandwidth;               // Bytes/s of the board, shared by its cores
+} Projection;
+
+// One weight matrix for batch vectors: the weights are streamed once per core_batch of them.
+static Work weight_work(const ModelLayer &l, const Projection &p, double vectors) {
+    Work w;
+    w.macs = l.rows * l.cols * vectors * l.count;
+    w.bytes = l.rows * l.cols * p.weight_bits / 8.0 * ceil(vectors / p.core_batch) * l.count;
+    return w;
+}
+
+// Attention for batch sequences at the given context: every sequence reads its own cache.
+static Work attention_work(const Model &m, double sequences, double context) {
+    Work w;
+    w.macs = 2 * context * m.kv_width * sequences * m.kv_layers;
+    w.bytes = w.macs;
+    return w;
+}
+
+// Decode: one token of each of batch sequences. Prefill: context tokens of one prompt, with
+// causal attention over 1..context positions.
+static void pass_work(const Model &m, const Projection &p, std::vector<Work> *decode, std::vector<Work> *prefill) {
+    for (const ModelLayer &l : m.layers) {
+        decode->push_back(weight_work(l, p, p.batch));
+        prefill->push_back(weight_work(l, p, p.context));
+    }
+    decode->push_back(attention_work(m, p.batch, p.context));
+    prefill->push_back(attention_work(m, 1, (p.context + 1) / 2.0 * p.context));
+}
+
+static double total_seconds(const std::vector<Work> &work, double peak_mac_s, double bytes_s) {
+    double seconds = 0;
+    for (const Work &w : work) {
+        seconds += w.seconds(peak_mac_s, bytes_s);
+    }
+    return seconds;
+}
+
+/*
+Roofline of the model on the synthesized core: per layer, the arithmetic intensity and whether
+it is memory- or compute-bound on 1 and on `cores` cores, then decode and prefill tokens/s and
+board $ per token/s at both nodes.
+*/
+static void roofline(const Model &m, const Projection &p, int cores, double macs_per_cycle,
+                     const double freq_ghz[2], const double area_um2[2], const double node_nm[2],
+                     const double cost_per_um2[2]) {
+    std::vector<Work> decode, prefill;
+    pass_work(m, p, &decode, &prefill);
+    double peak = macs_per_cycle * freq_ghz[0] * 1e9;
+    double weight_bytes = 0;
+    for (const ModelLayer &l : m.layers) {
+        weight_bytes += l.rows * l.cols * p.weight_bits / 8.0 * l.count;
+    }
+
+    printf("\n=== Roofline: %s, %d-bit weights, batch %d, context %d ===\n", m.name, p.weight_bits, p.batch,
+           p.context);
+    printf("   Weights              : %.2f GB%s\n", weight_bytes / 1e9,
+           weight_bytes > RAM_CAPACITY_GB * 1e9 ? " (exceeds the board's RAM)" : "");
+    printf("   Core peak (45nm)     : %.2f GMAC/s, ridge point %.2f MAC/byte at %.0f GB/s\n", peak / 1e9,
+           peak / p.bandwidth, p.bandwidth / 1e9);
+    printf("   Layer\t\tShape\t\tMAC/byte\t1 core\t\t%d cores\tDecode time\n", cores);
+    double decode_s = total_seconds(decode, peak * cores, p.bandwidth);
+    for (size_t i = 0; i < decode.size(); i++) {
+        const Work &w = decode[i];
+        char name[40], shape[40];
+        if (i < m.layers.size()) {
+            snprintf(name, sizeof(name), "%s", m.layers[i].name);
+            snprintf(shape, sizeof(shape), "%.0fx%.0f", m.layers[i].rows, m.layers[i].cols);
+        } else {
+            snprintf(name, sizeof(name), "attention");
+            snprintf(shape, sizeof(shape), "%dx%.0f", p.context, m.kv_width);
+        }
+        printf("   %-12s\t%-12s\t%.2f\t\t%s\t\t%s\t\t%.1f%%\n", name, shape, w.macs / w.bytes,
+               w.compute_bound(peak, p.bandwidth) ? "compute" : "memory",
+               w.compute_bound(peak * cores, p.bandwidth) ? "compute" : "memory",
+               100.0 * w.seconds(peak * cores, p.bandwidth) / decode_s);
+    }
+
+    // Cores of a board share its DRAM bandwidth; only compute-bound work gains from more cores.
+    printf("   Node\tCores\tDecode tok/s\tPrefill tok/s\tBoard cost\t$/(tok/s)\n");
+    for (int n = 0; n < 2; n++) {
+        double node_peak = macs_per_cycle * freq_ghz[n] * 1e9;
+        for (int c : {1, cores}) {
+            double tok_s = p.batch / total_seconds(decode, node_peak * c, p.bandwidth);
+            double prefill_tok_s = p.context / total_seconds(prefill, node_peak * c, p.bandwidth);
+            double cost = calculate_system_cost(area_um2[n], freq_ghz[n], macs_per_cycle, node_nm[n],
+                                                node_peak * c / 1e9, cost_per_um2[n], false);
+            printf("   %.0fnm\t%d\t%.2f\t\t%.1f\t\t$%.2f\t\t$%.3f\n", node_nm[n], c, tok_s, prefill_tok_s, cost,
+                   cost / tok_s);
+            if (cores == 1) {
+                break;
+            }
+        }
+    }
+}
+
+/*
+Usage: yosys -s yosys/synth.ys | analyze_yosys [options] [baseline.log], or analyze_yosys sweep ... (see above)
+With a baseline (the yosys log of another configuration), the area difference is reported.
+Options for the roofline of a model (see load_model):
+    --model 7B|13B|file  --batch n (1)  --context n (2048)  --cores n (8)  --bits n (as synthesized)
+    --bandwidth GB/s (MEMORY_BANDWIDTH_GB_S)
+*/
+int main(int argc, char **argv) {
+    if (argc > 1 && !strcmp(argv[1], "sweep")) {
+        return sweep(argc - 2, argv + 2);
+    }
+    const char *baseline_path = NULL, *model_spec = NULL;
+    int model_batch = 1, context = 2048, cores = 8, bits = 0;
+    double bandwidth_gb_s = MEMORY_BANDWIDTH_GB_S;
+    for (int i = 1; i < argc; i++) {
+        bool value = i + 1 < argc;
+        if (!strcmp(argv[i], "--model") && value) {
+            model_spec = argv[++i];
+        } else if (!strcmp(argv[i], "--batch") && value) {
+            model_batch = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--context") && value) {
+            context = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--cores") && value) {
+            cores = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--bits") && value) {
+            bits = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--bandwidth") && value) {
+            bandwidth_gb_s = atof(argv[++i]);
+        } else if (argv[i][0] != '-' && !baseline_path) {
+            baseline_path = argv[i];
+        } else {
+            fprintf(stderr, "Unknown argument %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (model_batch < 1 || context < 1 || cores < 1 || bandwidth_gb_s <= 0 || (bits != 0 && bits != 4 && bits != 8)) {
+        fprintf(stderr, "Error: invalid roofline option.\n");
+        return 1;
+    }
+    Model model;
+    if (model_spec && !load_model(model_spec, &model)) {
+        return 1;
+    }
+
+    char line[1024];
+    Synthesis synth;
+    CellStats cells;
+    int lanes = 0, rows = 1, batch = 1, weight_bits = 8;
 
     while (fgets(line, sizeof(line), stdin)) {
-        if (strstr(line, "ABC:") && strstr(line, "Gates") && strstr(line, "Area") && strstr(line, "Delay")) {
-            sscanf(line,
-                "ABC: WireLoad = \"none\" Gates = %lf %*[^A]Area = %lf %*[^D]Delay = %lf",
-                &gates, &area, &delay_ps);
+        parse_abc(line, &synth);
+        parse_stat(line, &cells);
+        // Printed by hierarchy -chparam when the design is elaborated.
+        int value;
+        if (sscanf(line, "Parameter \\LANES = %d", &value) == 1) {
+            lanes = value;
+        }
+        if (sscanf(line, "Parameter \\ROWS = %d", &value) == 1) {
+            rows = value;
+        }
+        if (sscanf(line, "Parameter \\BATCH = %d", &value) == 1) {
+            batch = value;
+        }
+        if (sscanf(line, "Parameter \\WEIGHT_BITS = %d", &value) == 1) {
+            weight_bits = value;
         }
     }
 
+    // Area from stat -liberty, which includes the flip-flops mapped by dfflibmap; ABC's only has
+    // the combinational logic.
+    double gates = synth.gates, area = stat_area(cells), delay_ps = synth.delay_ps;
     if (gates == 0 || area == 0 || delay_ps == 0) {
         fprintf(stderr, "Error: Failed to parse synthesis data.\n");
         return 1;
     }
+    if (cells.unmapped_flip_flops > 0) {
+        fprintf(stderr, "Warning: %d flip-flops not mapped to library cells, their area is missing.\n",
+                cells.unmapped_flip_flops);
+    }
+
+    double baseline_area = 0;
+    int baseline_flip_flops = 0;
+    if (baseline_path) {
+        FILE *f = fopen(baseline_path, "r");
+        if (!f) {
+            perror(baseline_path);
+            return 1;
+        }
+        CellStats baseline;
+        while (fgets(line, sizeof(line), f)) {
+            parse_stat(line, &baseline);
+        }
+        fclose(f);
+        baseline_area = stat_area(baseline);
+        baseline_flip_flops = baseline.flip_flops;
+        if (baseline_area == 0) {
+            fprintf(stderr, "Error: Failed to parse synthesis data in %s.\n", baseline_path);
+            return 1;
+        }
+    }
+
+    if (lanes == 0) {
+        fprintf(stderr, "Warning: LANES parameter not found, assuming 1 MAC per cycle.\n");
+        lanes = 1;
+    }
 
     // Common parameters
-    double macs_per_cycle = 1.0;
-    double target_gmac = 40.0;
-    double memory_bandwidth_gb_s = MEMORY_BANDWIDTH_GB_S;
+    double macs_per_cycle = lanes * rows * batch;
+    double target_gmac = TARGET_GMAC;
     
     // Frequency calculation
     double freq_ghz_45nm = 1000.0 / delay_ps;
@@ -86,7 +723,7 @@ int main() {
     double to_node_size = 16.0;
     
     // Cost per unit area at different nodes
-    double cost_per_um2_45nm = 0.0000035;  // in USD
+    double cost_per_um2_45nm = COST_PER_UM2_45NM;
     double cost_per_um2_16nm = 0.000015;   // in USD
     
     // Dennard scaling approximations
@@ -100,7 +737,16 @@ int main() {
     // Print results
     printf("=== Performance Summary ===\n");
     printf("   Gates                : %.0f\n", gates);
-    printf("   Memory Bandwidth     : %.2f GB/s\n", memory_bandwidth_gb_s);
+    printf("   MACs per cycle       : %d (%d lanes x %d rows x %d batch)\n", lanes * rows * batch, lanes, rows, batch);
+    printf("   Weight bits          : %d (%.2f weight bytes per cycle)\n", weight_bits, lanes * rows * weight_bits / 8.0);
+    printf("   Flip-flops           : %d\n", cells.flip_flops);
+    printf("   Perf counters area   : %.2f µm² (%.2f%%)\n", cells.counters_area, cells.counters_area / area * 100.0);
+    if (baseline_area > 0) {
+        printf("   Area vs baseline     : %+.2f µm² (%+.1f%%)\n", area - baseline_area,
+               (area / baseline_area - 1.0) * 100.0);
+        printf("   Flip-flops vs base   : %+d\n", cells.flip_flops - baseline_flip_flops);
+    }
+    printf("   Memory Bandwidth     : %.2f GB/s\n", bandwidth_gb_s);
     printf("   Target Performance   : %.2f GMAC\n\n", target_gmac);
 
     // Calculate and print system costs for both nodes
@@ -114,6 +760,20 @@ int main() {
     
     printf("Cost comparison: 16nm is %.2f%% of 45nm cost\n", 
            (cost_16nm / cost_45nm) * 100.0);
+
+    if (model_spec) {
+        Projection p;
+        p.weight_bits = bits ? bits : weight_bits;
+        p.batch = model_batch;
+        p.context = context;
+        p.core_batch = batch;
+        p.bandwidth = bandwidth_gb_s * 1e9;
+        const double freq_ghz[2] = {freq_ghz_45nm, freq_ghz_16nm};
+        const double area_um2[2] = {area, area_16nm};
+        const double node_nm[2] = {from_node_size, to_node_size};
+        const double cost_per_um2[2] = {cost_per_um2_45nm, cost_per_um2_16nm};
+        roofline(model, p, cores, macs_per_cycle, freq_ghz, area_um2, node_nm, cost_per_um2);
+    }
     
     return 0;
 }
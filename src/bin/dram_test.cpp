@@ -1,10 +1,16 @@
 #include "dram.h"
+#include "write_combiner.h"
 #include <iostream>
 #include <cassert>
 #include <cstring>
+#include <unistd.h>
+#include <vector>
 
-// Function prototype
+// Function prototypes
 void clock_cycle(Dram &dram);
+int read_latency(Dram &dram, size_t address);
+void issue_read(Dram &dram, size_t address, size_t arlen, size_t arsize, int arid);
+double stream_gbps(Dram &dram, int bursts, size_t arlen);
 
 // Function to advance clock by one cycle
 void clock_cycle(Dram &dram) {
@@ -17,6 +23,61 @@ void clock_cycle(Dram &dram) {
     dram.eval();
 }
 
+// Issue a single-beat read and return the number of cycles until rvalid.
+int read_latency(Dram &dram, size_t address) {
+    dram.in.arvalid = 1;
+    dram.in.araddr = address;
+    dram.in.arlen = 0;
+    dram.in.arsize = 0;
+    dram.in.arburst = 1;
+    clock_cycle(dram);
+    dram.in.arvalid = 0;
+
+    for (int i = 1; i < 1000; i++) {
+        clock_cycle(dram);
+        if (dram.out.rvalid) {
+            return i;
+        }
+    }
+    assert(false);
+    return -1;
+}
+
+// Issue a read burst, waiting for arready.
+void issue_read(Dram &dram, size_t address, size_t arlen, size_t arsize, int arid) {
+    dram.in.arvalid = 1;
+    dram.in.araddr = address;
+    dram.in.arlen = arlen;
+    dram.in.arsize = arsize;
+    dram.in.arburst = 1;
+    dram.in.arid = arid;
+    while (!dram.out.arready) {
+        clock_cycle(dram);
+    }
+    clock_cycle(dram);
+    dram.in.arvalid = 0;
+}
+
+// Stream full-width bursts back to back, keeping the DRAM busy, and return the achieved GB/s.
+double stream_gbps(Dram &dram, int bursts, size_t arlen) {
+    dram.reset_stats();
+    size_t burst_bytes = (arlen + 1) * 32;
+    int issued = 0, completed = 0;
+    dram.in.arlen = arlen;
+    dram.in.arsize = 5;
+    dram.in.arburst = 1;
+    while (completed < bursts) {
+        dram.in.arvalid = issued < bursts;
+        dram.in.araddr = issued * burst_bytes;
+        bool accepted = dram.in.arvalid && dram.out.arready;
+        clock_cycle(dram);
+        issued += accepted;
+        completed += dram.out.rvalid && dram.out.rlast;
+    }
+    dram.in.arvalid = 0;
+    return dram.stats.bandwidth_gbps(dram.timing.clock_ghz);
+}
+
 int main() {
     srand(42); // Deterministic random seed for testing
 
@@ -26,7 +87,7 @@ int main() {
     
     // Initialize memory with some test data
     for (size_t i = 0; i < MEM_SIZE; i++) {
-        dram.data[i] = i & 0xFF;
+        dram.data.write8(i, i & 0xFF);
     }
     
     std::cout << "DRAM Test Started" << std::endl;
@@ -49,7 +110,7 @@ int main() {
     
     bool read_completed = false;
     // Wait for the read to complete
-    for (int i = 0; i < 15; i++) {
+    for (int i = 0; i < 100; i++) {
         clock_cycle(dram);
         printf("Cycle %d: arready=%d, rvalid=%d, rdata=0x%02X, rlast=%d\n", 
                i, dram.out.arready, dram.out.rvalid, 
@@ -77,7 +138,7 @@ int main() {
     
     // Wait for the burst read to complete
     int transfers_received = 0;
-    for (int i = 0; i < 20; i++) {
+    for (int i = 0; i < 100; i++) {
         clock_cycle(dram);
         if (dram.out.rvalid) {
             std::cout << "Burst read data " << transfers_received << ": 0x" 
@@ -106,7 +167,7 @@ int main() {
     
     // Wait for the burst read to complete
     transfers_received = 0;
-    for (int i = 0; i < 20; i++) {
+    for (int i = 0; i < 100; i++) {
         clock_cycle(dram);
         if (dram.out.rvalid) {
             uint32_t data = 0;
@@ -123,7 +184,7 @@ int main() {
             // For 4-byte transfers, each address increment is by 4
             uint32_t expected = 0;
             for (int j = 0; j < 4; j++) {
-                expected |= (uint32_t)(*(dram.data + 0x30 + (transfers_received * 4) + j)) << (j * 8);
+                expected |= (uint32_t)(dram.data.read8(0x30 + (transfers_received * 4) + j)) << (j * 8);
             }
             assert(data == expected);
             
@@ -149,7 +210,7 @@ int main() {
     
     // Wait for the larger burst read to complete
     transfers_received = 0;
-    for (int i = 0; i < 30; i++) {
+    for (int i = 0; i < 100; i++) {
         clock_cycle(dram);
         if (dram.out.rvalid) {
             uint16_t data = 0;
@@ -166,8 +227,8 @@ int main() {
             
             // For 2-byte transfers, each address increment is by 2
             uint16_t expected = 0;
-            expected = *(dram.data + 0x40 + (transfers_received * 2)) | 
-                      (*(dram.data + 0x40 + (transfers_received * 2) + 1) << 8);
+            expected = dram.data.read8(0x40 + (transfers_received * 2)) | 
+                      (dram.data.read8(0x40 + (transfers_received * 2) + 1) << 8);
             assert(data == expected);
             
             transfers_received++;
@@ -192,7 +253,7 @@ int main() {
     
     // Wait for the extra large burst read to complete
     transfers_received = 0;
-    for (int i = 0; i < 50; i++) {
+    for (int i = 0; i < 100; i++) {
         clock_cycle(dram);
         if (dram.out.rvalid) {
             uint32_t data = 0;
@@ -209,7 +270,7 @@ int main() {
             // For 4-byte transfers, each address increment is by 4
             uint32_t expected = 0;
             for (int j = 0; j < 4; j++) {
-                expected |= (uint32_t)(*(dram.data + 0x80 + (transfers_received * 4) + j)) << (j * 8);
+                expected |= (uint32_t)(dram.data.read8(0x80 + (transfers_received * 4) + j)) << (j * 8);
             }
             assert(data == expected);
             
@@ -222,6 +283,422 @@ int main() {
     }
     assert(transfers_received == 16);
     
+    // Test 6: Row buffer timing
+    std::cout << "Test 6: Row hit, miss and conflict latency" << std::endl;
+    {
+        DramTiming timing;
+        timing.tREFI = 0; // No refresh, so latencies are exact
+        Dram tdram(1 << 20, timing);
+        size_t bank_stride = timing.row_bytes * timing.bank_groups * timing.banks_per_group;
+
+        int miss = read_latency(tdram, 0x0);
+        int hit = read_latency(tdram, 0x40);
+        int conflict = read_latency(tdram, bank_stride); // Same bank, next row
+        int other_bank = read_latency(tdram, timing.row_bytes);
+        printf("miss=%d hit=%d conflict=%d other_bank=%d\n", miss, hit, conflict, other_bank);
+        assert(hit < miss);
+        assert(miss < conflict);
+        assert(other_bank == miss);
+        assert(tdram.stats.row_hits == 1);
+        assert(tdram.stats.row_misses == 2);
+        assert(tdram.stats.row_conflicts == 1);
+    }
+
+    // Test 7: Refresh blocks the device
+    std::cout << "Test 7: Refresh" << std::endl;
+    {
+        DramTiming timing;
+        timing.tREFI = 100;
+        Dram tdram(1 << 20, timing);
+        read_latency(tdram, 0x0);
+        int hit = read_latency(tdram, 0x20);
+        while (tdram.cycle < 100) {
+            clock_cycle(tdram);
+        }
+        int after_refresh = read_latency(tdram, 0x40); // Row was closed by refresh
+        printf("hit=%d after_refresh=%d\n", hit, after_refresh);
+        assert(tdram.stats.refreshes == 1);
+        assert(after_refresh > hit + timing.tRCD);
+    }
+
+    // Test 8: Seeded jitter is deterministic
+    std::cout << "Test 8: Deterministic jitter" << std::endl;
+    {
+        DramTiming timing;
+        timing.jitter = 8;
+        timing.seed = 1234;
+        Dram a(1 << 20, timing);
+        Dram b(1 << 20, timing);
+        timing.seed = 99;
+        Dram c(1 << 20, timing);
+        bool differs = false;
+        for (int i = 0; i < 16; i++) {
+            int la = read_latency(a, i * 0x20);
+            int lb = read_latency(b, i * 0x20);
+            int lc = read_latency(c, i * 0x20);
+            assert(la == lb);
+            differs |= la != lc;
+        }
+        assert(differs);
+    }
+
+    // Test 9: Out-of-order completion across IDs, in order within an ID
+    std::cout << "Test 9: Multiple outstanding bursts with ARID" << std::endl;
+    {
+        DramTiming timing;
+        timing.tREFI = 0;
+        Dram tdram(1 << 20, timing, 8);
+        for (size_t i = 0; i < (1 << 20); i++) {
+            tdram.data.write8(i, i & 0xFF);
+        }
+        size_t bank_stride = timing.row_bytes * timing.bank_groups * timing.banks_per_group;
+        read_latency(tdram, 0x0); // Open row 0 of bank 0
+        read_latency(tdram, timing.row_bytes); // Open row 0 of bank 1
+
+        // Slow burst (row conflict) on ID 0, then fast row hits on ID 1 and ID 0.
+        issue_read(tdram, bank_stride + 0x10, 3, 0, 0);
+        issue_read(tdram, timing.row_bytes + 0x20, 3, 0, 1);
+        issue_read(tdram, timing.row_bytes + 0x30, 3, 0, 0);
+
+        std::vector<int> order;
+        std::vector<size_t> first_byte;
+        while (order.size() < 3) {
+            clock_cycle(tdram);
+            if (tdram.out.rvalid && tdram.out.rlast) {
+                order.push_back(tdram.out.rid);
+                first_byte.push_back(*(tdram.out.rdata - 3));
+            }
+        }
+        printf("completion order: %d %d %d\n", order[0], order[1], order[2]);
+        assert(order[0] == 1 && first_byte[0] == 0x20); // Fast ID 1 first
+        assert(order[1] == 0 && first_byte[1] == 0x10); // ID 0 in order
+        assert(order[2] == 0 && first_byte[2] == 0x30);
+        assert(tdram.outstanding_reads() == 0);
+    }
+
+    // Test 10: arready backpressure at the outstanding limit
+    std::cout << "Test 10: Outstanding limit" << std::endl;
+    {
+        Dram tdram(1 << 20, DramTiming(), 2);
+        tdram.in.rready = 0;
+        issue_read(tdram, 0x0, 0, 0, 0);
+        issue_read(tdram, 0x20, 0, 0, 1);
+        assert(tdram.outstanding_reads() == 2);
+        assert(!tdram.out.arready);
+        for (int i = 0; i < 100; i++) {
+            clock_cycle(tdram);
+            assert(!tdram.out.rvalid && !tdram.out.arready);
+        }
+        tdram.in.rready = 1;
+        issue_read(tdram, 0x40, 0, 0, 2); // Waits for a slot to free up
+        assert(tdram.outstanding_reads() <= 2);
+        bool received = false;
+        for (int i = 0; i < 200 && !received; i++) {
+            clock_cycle(tdram);
+            received = tdram.out.rvalid && tdram.out.rid == 2;
+        }
+        assert(received);
+        assert(tdram.outstanding_reads() == 0);
+    }
+
+    // Test 11: Full-width 256-bit beats
+    std::cout << "Test 11: Burst Read with 32-byte beats" << std::endl;
+    {
+        Dram tdram(1 << 20);
+        for (size_t i = 0; i < (1 << 20); i++) {
+            tdram.data.write8(i, (i * 7) & 0xFF);
+        }
+        issue_read(tdram, 0x1000, 7, 5, 0);
+        transfers_received = 0;
+        for (int i = 0; i < 200; i++) {
+            clock_cycle(tdram);
+            if (tdram.out.rvalid) {
+                assert(memcmp(tdram.out.rdata, tdram.data.read_ptr(0x1000 + transfers_received * 32), 32) == 0);
+                transfers_received++;
+                if (tdram.out.rlast) break;
+            }
+        }
+        assert(transfers_received == 8);
+        assert(tdram.stats.bytes_read == 8 * 32);
+        assert(tdram.stats.busy_beats == 8);
+    }
+
+    // Test 12: Bandwidth cap and accounting
+    std::cout << "Test 12: Bandwidth cap" << std::endl;
+    {
+        Dram tdram(1 << 24);
+        double gbps = stream_gbps(tdram, 256, 15);
+        tdram.print_stats();
+        assert(gbps <= tdram.timing.max_bytes_per_ns + 0.01);
+        assert(gbps > 0.8 * tdram.timing.max_bytes_per_ns); // Streaming keeps the bus busy
+        assert(tdram.stats.bursts == 256);
+        assert(tdram.stats.busy_beats + tdram.stats.idle_beats == tdram.stats.cycles);
+        assert(tdram.stats.latency_percentile(0.99) >= tdram.stats.avg_latency());
+
+        DramTiming timing;
+        timing.max_bytes_per_ns = 16.0;
+        Dram slow(1 << 24, timing);
+        double slow_gbps = stream_gbps(slow, 256, 15);
+        printf("capped at %.1f GB/s: %.2f GB/s\n", timing.max_bytes_per_ns, slow_gbps);
+        assert(slow_gbps <= 16.0 + 0.01 && slow_gbps > 14.0); // Refresh costs a few percent
+        assert(slow.stats.throttled > 0);
+    }
+
+    // Test 13: Lazily materialized storage
+    std::cout << "Test 13: Sparse 4 GB storage" << std::endl;
+    {
+        Dram big((size_t)4 << 30);
+        assert(big.data.resident_bytes() == 0);
+        size_t addr = ((size_t)3 << 30) + 0x1234;
+        assert(big.data.read8(addr) == 0xAB);
+        big.data.write8(addr, 0x5A);
+        assert(big.data.read8(addr) == 0x5A);
+        assert(big.data.read8(addr + 1) == 0xAB);
+        assert(big.data.resident_bytes() == DramStorage::PAGE_SIZE);
+
+        // A beat crossing a page boundary.
+        size_t boundary = 5 * DramStorage::PAGE_SIZE;
+        big.data.write8(boundary - 1, 0x11);
+        big.data.write8(boundary, 0x22);
+        issue_read(big, boundary - 16, 0, 5, 0);
+        for (int i = 0; i < 200 && !big.out.rvalid; i++) {
+            clock_cycle(big);
+        }
+        assert(big.out.rvalid);
+        assert(big.out.rdata[15] == 0x11 && big.out.rdata[16] == 0x22 && big.out.rdata[0] == 0xAB);
+    }
+
+    // Test 14: Mapping a weight image file
+    std::cout << "Test 14: Mapped file" << std::endl;
+    {
+        char path[] = "/tmp/dram_test_XXXXXX";
+        int fd = mkstemp(path);
+        assert(fd >= 0);
+        const size_t file_size = 3 * DramStorage::PAGE_SIZE + 100;
+        std::vector<uint8_t> image(file_size);
+        for (size_t i = 0; i < file_size; i++) {
+            image[i] = (i * 13 + 5) & 0xFF;
+        }
+        assert(write(fd, image.data(), file_size) == (ssize_t)file_size);
+        close(fd);
+
+        Dram mapped((size_t)1 << 30);
+        size_t base = 16 * DramStorage::PAGE_SIZE;
+        assert(mapped.data.map_file(path, base));
+        assert(mapped.data.resident_bytes() == DramStorage::PAGE_SIZE); // Only the tail page is copied
+        assert(mapped.data.read8(base + file_size) == 0xAB);
+
+        issue_read(mapped, base + 0x20000, 15, 5, 0);
+        transfers_received = 0;
+        for (int i = 0; i < 200; i++) {
+            clock_cycle(mapped);
+            if (mapped.out.rvalid) {
+                assert(memcmp(mapped.out.rdata, &image[0x20000 + transfers_received * 32], 32) == 0);
+                transfers_received++;
+                if (mapped.out.rlast) break;
+            }
+        }
+        assert(transfers_received == 16);
+
+        // Writes are copy-on-write and don't reach the file.
+        mapped.data.write8(base + 7, 0xEE);
+        assert(mapped.data.read8(base + 7) == 0xEE);
+        Dram other((size_t)1 << 30);
+        assert(other.data.map_file(path, 0));
+        assert(other.data.read8(7) == image[7]);
+        unlink(path);
+    }
+
+    // Test 15: Write burst with byte strobes
+    std::cout << "Test 15: Write burst" << std::endl;
+    {
+        Dram tdram(1 << 20);
+        uint8_t beat0[32], beat1[32];
+        for (int i = 0; i < 32; i++) {
+            beat0[i] = i;
+            beat1[i] = 0x80 + i;
+        }
+        tdram.in.awvalid = 1;
+        tdram.in.awaddr = 0x400;
+        tdram.in.awlen = 1;
+        tdram.in.awsize = 5;
+        tdram.in.awburst = 1;
+        tdram.in.awid = 3;
+        clock_cycle(tdram);
+        tdram.in.awvalid = 0;
+        assert(tdram.out.wready);
+
+        tdram.in.wvalid = 1;
+        tdram.in.wdata = beat0;
+        tdram.in.wstrb = ~0ull;
+        tdram.in.wlast = 0;
+        clock_cycle(tdram);
+        tdram.in.wdata = beat1;
+        tdram.in.wstrb = 0x0000FFFF; // Only the lower half
+        tdram.in.wlast = 1;
+        clock_cycle(tdram);
+        tdram.in.wvalid = 0;
+
+        bool responded = false;
+        for (int i = 0; i < 200 && !responded; i++) {
+            clock_cycle(tdram);
+            responded = tdram.out.bvalid;
+        }
+        assert(responded && tdram.out.bid == 3);
+        assert(tdram.stats.bytes_written == 48);
+        assert(memcmp(tdram.data.read_ptr(0x400), beat0, 32) == 0);
+        assert(memcmp(tdram.data.read_ptr(0x420), beat1, 16) == 0);
+        assert(tdram.data.read8(0x430) == 0xAB);
+        assert(tdram.outstanding_writes() == 0);
+    }
+
+    // Test 16: Write combining 32-bit results while streaming reads
+    std::cout << "Test 16: Write combining" << std::endl;
+    {
+        DramTiming timing;
+        Dram tdram(1 << 24, timing);
+        double read_only = stream_gbps(tdram, 128, 15);
+
+        Dram mixed(1 << 24, timing);
+        WriteCombiner wc;
+        const size_t out_base = 1 << 23;
+        const uint32_t results = 4096;
+        uint32_t written = 0;
+        int issued = 0, completed = 0;
+        double mixed_read = 0;
+        mixed.in.arlen = 15;
+        mixed.in.arsize = 5;
+        mixed.in.arburst = 1;
+        while (completed < 128 || !wc.idle()) {
+            // One 32-bit result per cycle, like a core writing back a layer.
+            if (written < results) {
+                uint32_t value = written * 2654435761u;
+                if (wc.write(out_base + written * 4, &value, 4)) {
+                    written++;
+                }
+            }
+            if (written == results) {
+                wc.flush();
+            }
+            wc.tick(mixed);
+            mixed.in.arvalid = issued < 128;
+            mixed.in.araddr = issued * 512;
+            bool accepted = mixed.in.arvalid && mixed.out.arready;
+            clock_cycle(mixed);
+            issued += accepted;
+            completed += mixed.out.rvalid && mixed.out.rlast;
+            if (completed == 128 && mixed_read == 0) {
+                mixed_read = mixed.stats.bandwidth_gbps(timing.clock_ghz);
+            }
+        }
+        mixed.print_stats();
+        printf("read only: %.2f GB/s, with writeback: %.2f GB/s read\n", read_only, mixed_read);
+
+        for (uint32_t i = 0; i < results; i++) {
+            uint32_t value;
+            mixed.data.read(out_base + i * 4, &value, 4);
+            assert(value == i * 2654435761u);
+        }
+        assert(wc.stats.full_beats == results * 4 / 32);
+        assert(wc.stats.partial_beats == 0);
+        assert(mixed.stats.write_beats == results * 4 / 32);
+        assert(mixed.stats.turnarounds > 0);
+        assert(mixed_read < read_only);
+    }
+
+    // Test 17: Fast-forward over idle cycles gives the same responses at the same cycles
+    std::cout << "Test 17: Fast-forward" << std::endl;
+    {
+        DramTiming timing;
+        timing.tREFI = 500; // Refreshes within the run
+        timing.jitter = 16;
+        timing.seed = 7;
+        // Sparse traffic: a read burst or a write burst every few hundred cycles, with rready low
+        // for a while now and then.
+        auto run = [&](bool fast, uint64_t *skipped) {
+            Dram tdram(1 << 20, timing);
+            std::vector<uint64_t> log; // Cycle, first byte and stalls so far of every R beat, cycle of every B
+            uint8_t wdata[32];
+            uint64_t next_request = 10;
+            int requests = 0, w_left = 0;
+            srand(17);
+            // The next request, drawn once it has been accepted.
+            auto draw = [&]() {
+                tdram.in.araddr = tdram.in.awaddr = (size_t)(rand() % 4096) * 32;
+                tdram.in.arlen = tdram.in.awlen = rand() % 8;
+                tdram.in.arid = rand() % 4;
+            };
+            draw();
+            *skipped = 0;
+            while (requests < 40 || tdram.outstanding_reads() || tdram.outstanding_writes() || tdram.out.rvalid) {
+                bool request = tdram.cycle + 1 >= next_request && requests < 40 && !w_left;
+                tdram.in.arvalid = request && requests % 3 != 2;
+                tdram.in.awvalid = request && requests % 3 == 2;
+                tdram.in.arsize = tdram.in.awsize = 5;
+                tdram.in.arburst = tdram.in.awburst = 1;
+                tdram.in.wvalid = w_left > 0;
+                tdram.in.wdata = wdata;
+                tdram.in.wlast = w_left == 1;
+                tdram.in.rready = tdram.cycle % 1000 < 800;
+                memset(wdata, w_left, sizeof(wdata));
+                uint64_t wait = next_request > tdram.cycle + 1 ? next_request - tdram.cycle - 1 : 0;
+                if (fast && !request && !w_left) {
+                    uint64_t idle = std::min(tdram.next_event_cycle() - tdram.cycle - 1, wait);
+                    // Inputs hold for the whole stretch, rready changes at phases 800 and 0.
+                    uint64_t phase = tdram.cycle % 1000;
+                    idle = std::min(idle, (phase < 800 ? 800 : 1000) - phase);
+                    if (idle > 0) {
+                        tdram.fast_forward(idle);
+                        *skipped += idle;
+                        continue;
+                    }
+                }
+                bool aw = tdram.in.awvalid && tdram.out.awready;
+                bool ar = tdram.in.arvalid && tdram.out.arready;
+                bool w = tdram.in.wvalid && tdram.out.wready;
+                clock_cycle(tdram);
+                if (aw) w_left = (int)tdram.in.awlen + 1;
+                if (ar || aw) {
+                    requests++;
+                    next_request = tdram.cycle + 50 + rand() % 400;
+                    draw();
+                }
+                if (w) w_left--;
+                if (tdram.out.rvalid) {
+                    log.push_back(tdram.cycle << 8 | *tdram.out.rdata);
+                    log.push_back(tdram.stats.stalled);
+                }
+                if (tdram.out.bvalid) log.push_back(tdram.cycle << 8 | 0xFF);
+                assert(tdram.cycle < 100000);
+            }
+            tdram.in.arvalid = tdram.in.awvalid = tdram.in.wvalid = false;
+            // Trailing idle cycles, then one more request after the gap.
+            if (fast) {
+                tdram.fast_forward(1234);
+            } else {
+                for (int i = 0; i < 1234; i++) clock_cycle(tdram);
+            }
+            log.push_back(read_latency(tdram, 0x40));
+            Dram::Stats stats = tdram.stats;
+            log.push_back(tdram.cycle);
+            log.push_back(stats.cycles);
+            log.push_back(stats.idle_beats);
+            log.push_back(stats.stalled);
+            log.push_back(stats.throttled);
+            log.push_back(stats.refreshes);
+            log.push_back(stats.latency_sum);
+            log.push_back(stats.bytes_written);
+            return log;
+        };
+        uint64_t skipped_slow, skipped_fast;
+        std::vector<uint64_t> slow = run(false, &skipped_slow);
+        std::vector<uint64_t> fast = run(true, &skipped_fast);
+        printf("%zu events, %llu of %llu cycles skipped\n", slow.size(), (unsigned long long)skipped_fast,
+               (unsigned long long)slow[slow.size() - 8]);
+        assert(slow == fast);
+        assert(skipped_fast > slow[slow.size() - 8] / 2);
+    }
+
     std::cout << "DRAM Test Completed Successfully" << std::endl;
     return 0;
 }
\ No newline at end of file
@@ -1,68 +1,111 @@
+#include "reference.h"
+#include <atomic>
+#include <chrono>
 #include <stdio.h>
 #include <stdlib.h>
-#include <assert.h>
+#include <vector>
 
-class Tensor {
-public:
-    int *data;
-    int hdim;
-    int vdim;
+// Checks every dot product kernel of the reference library against the scalar one, and times them.
+// Usage: matmul [rows cols]
 
-    Tensor(int hdim, int vdim) : hdim(hdim), vdim(vdim) {
-        data = new int[hdim * vdim];
-        if (data == NULL) {
-            fprintf(stderr, "Memory allocation failed\n");
-            exit(1);
+static double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void fill_random(uint8_t *data, size_t n, uint8_t mask) {
+    for (size_t i = 0; i < n; i++) {
+        data[i] = (uint8_t)(rand() & mask);
+    }
+}
+
+// Compares all kernels on one shape; returns false on a mismatch.
+static bool check_shape(size_t rows, size_t cols) {
+    const int batch = 4;
+    const size_t group = 32;
+    const int shift = 8;
+    Matrix8 m(rows, cols);
+    Matrix8 xs(batch, cols);
+    Matrix4 q(rows, cols, group);
+    for (size_t r = 0; r < rows; r++) {
+        fill_random(m.row(r), cols, 0xFF);
+        fill_random(q.packed.row(r), (cols + 1) / 2, 0xFF);
+        for (size_t g = 0; g < q.groups; g++) {
+            q.scale(r, g) = (uint16_t)rand();
         }
     }
-    ~Tensor() {
-        delete[] data;
-        data = NULL;
+    for (int b = 0; b < batch; b++) {
+        fill_random(xs.row(b), cols, 0xFF);
     }
-};
-
-static void matmul(const Tensor *matrix, const Tensor *input, Tensor *output) {
-    assert(matrix != NULL);
-    assert(input != NULL);
-    assert(output != NULL);
-    assert(input->hdim == matrix->hdim);
-    assert(output->hdim == matrix->vdim);
+    std::vector<uint8_t> p(rows);
+    fill_random(p.data(), rows, 0xFF);
 
-    for (int i = 0; i < matrix->hdim; i++) {
-        for (int j = 0; j < input->vdim; j++) {
-            for (int k = 0; k < matrix->vdim; k++) {
-                output->data[i * output->vdim + j] += matrix->data[i * matrix->vdim + k] * input->data[k];
+    // Scalar results, on one thread and without the library loops.
+    std::vector<uint32_t> expected(rows), expected_batch(batch * rows), expected_q4(rows), expected_t(cols, 0);
+    for (size_t r = 0; r < rows; r++) {
+        expected[r] = dot_scalar(m.row(r), xs.row(0), cols);
+        for (int b = 0; b < batch; b++) {
+            expected_batch[b * rows + r] = dot_scalar(m.row(r), xs.row(b), cols);
+        }
+        uint32_t sum = 0;
+        for (size_t g = 0; g < q.groups; g++) {
+            uint64_t d = 0;
+            for (size_t c = g * group; c < (g + 1) * group && c < cols; c++) {
+                d += q.get(r, c) * xs.row(0)[c];
             }
+            sum += (uint32_t)((d * q.scale(r, g) + (1 << (shift - 1))) >> shift);
         }
+        expected_q4[r] = sum;
+        for (size_t c = 0; c < cols; c++) {
+            expected_t[c] += (uint32_t)p[r] * m.row(r)[c];
+        }
+    }
+
+    bool ok = true;
+    std::vector<uint32_t> y(rows), y_batch(batch * rows), y_q4(rows), y_t(cols);
+    printf("%zu x %zu, %zu threads\n", rows, cols, ThreadPool::shared().size());
+    for (const DotImpl &kernel : dot_kernels()) {
+        auto start = std::chrono::steady_clock::now();
+        gemv(m, xs.row(0), y.data(), kernel.fn);
+        double t = seconds_since(start);
+        gemm(m, xs, y_batch.data(), kernel.fn);
+        gemv_q4(q, xs.row(0), y_q4.data(), shift, kernel.fn);
+        bool match = y == expected && y_batch == expected_batch && y_q4 == expected_q4;
+        printf("  %-12s gemv %8.2f GMAC/s  %s\n", kernel.name, (double)rows * (double)cols / t * 1e-9, match ? "ok" : "MISMATCH");
+        ok = ok && match;
     }
+    gemv_t(m, p.data(), y_t.data());
+    bool match_t = y_t == expected_t;
+    printf("  transposed   %s\n", match_t ? "ok" : "MISMATCH");
+    return ok && match_t;
 }
 
 int main(int argc, char *argv[]) {
-    (void)argc;
-    (void)argv;
-
-    // Create test input data and a test matrix.
-    Tensor matrix(3, 3);
-    for (int i = 0; i < matrix.hdim; i++) {
-      for (int j = 0; j < matrix.vdim; j++) {
-        matrix.data[i * matrix.vdim + j] = (i * matrix.vdim + j);
-      }
+    srand(42);
+    if (argc == 3) {
+        return check_shape(strtoul(argv[1], NULL, 0), strtoul(argv[2], NULL, 0)) ? 0 : 1;
     }
-    Tensor input(3, 1);
-    for (int i = 0; i < input.hdim; i++) {
-        input.data[i] = i;
+    if (argc != 1) {
+        fprintf(stderr, "Usage: %s [rows cols]\n", argv[0]);
+        return 1;
     }
-    Tensor output(3, 1);
-    for (int i = 0; i < output.hdim; i++) {
-        output.data[i] = 0.0f; // Initialize output to zero
-    }
-    // Perform matrix multiplication.
-    matmul(&matrix, &input, &output);
-    // Print the output.
-    printf("Output:\n");
-    for (int i = 0; i < output.hdim; i++) {
-        printf("%d\n", output.data[i]);
+
+    // Odd sizes for the kernel tails, then the LLM layer shapes of the Verilator tests.
+    const size_t shapes[][2] = {{3, 4}, {7, 33}, {65, 200}, {4096, 4096}, {4096, 11008}};
+    bool ok = true;
+    for (const auto &shape : shapes) {
+        ok = check_shape(shape[0], shape[1]) && ok;
     }
 
-    return 0;
+    // A loop started from inside a loop runs inline instead of waiting on the pool.
+    ThreadPool pool(4);
+    std::atomic<size_t> nested{0};
+    pool.parallel_for(64, 1, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            pool.parallel_for(1000, 10, [&](size_t b, size_t e) { nested += e - b; });
+        }
+    });
+    printf("nested loops %s\n", nested == 64000 ? "ok" : "MISMATCH");
+    ok = ok && nested == 64000;
+    printf("%s\n", ok ? "All kernels match." : "Mismatch.");
+    return ok ? 0 : 1;
 }
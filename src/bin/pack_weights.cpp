@@ -0,0 +1,267 @@
+#include "json.h"
+#include "weight_image.h"
+#include <algorithm>
+#include <cmath>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Packs the 2-D tensors of a safetensors file (or one raw tensor) into a DRAM image for the core.
+// See weight_image.h for the layout.
+
+static void usage(const char *name) {
+    fprintf(stderr,
+            "Usage: %s [options] input output_prefix\n"
+            "Writes output_prefix.bin (DRAM image) and output_prefix.json (manifest).\n"
+            "  -b bits          8 (default) or 4 (grouped, a scale per LANES columns)\n"
+            "  -l lanes         core LANES (default 32)\n"
+            "  -r rows          core ROWS (default 1)\n"
+            "  -d depth         vector SRAM depth in words (default 1024)\n"
+            "  -t filter        only tensors whose name contains filter; may be repeated\n"
+            "  -a base          DRAM address of the image (default 0x10000)\n"
+            "  --raw name:rows:cols[:dtype]\n"
+            "                   input is one row-major tensor, dtype F32 (default), F16 or BF16\n",
+            name);
+}
+
+static float half_to_float(uint16_t h) {
+    uint32_t sign = (uint32_t)(h >> 15) << 31;
+    uint32_t exponent = (h >> 10) & 0x1F;
+    uint32_t mantissa = h & 0x3FF;
+    uint32_t bits;
+    if (exponent == 0x1F) {
+        bits = sign | 0x7F800000 | (mantissa << 13);
+    } else if (exponent != 0) {
+        bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+    } else if (mantissa == 0) {
+        bits = sign;
+    } else {
+        // Subnormal: normalize.
+        exponent = 113;
+        while (!(mantissa & 0x400)) {
+            mantissa <<= 1;
+            exponent--;
+        }
+        bits = sign | (exponent << 23) | ((mantissa & 0x3FF) << 13);
+    }
+    float f;
+    memcpy(&f, &bits, 4);
+    return f;
+}
+
+// Bytes per element of a safetensors dtype, 0 if not supported.
+static size_t dtype_bytes(const std::string &dtype) {
+    if (dtype == "F32") return 4;
+    if (dtype == "F16" || dtype == "BF16") return 2;
+    return 0;
+}
+
+static void to_float(const uint8_t *src, const std::string &dtype, size_t n, float *dst) {
+    for (size_t i = 0; i < n; i++) {
+        if (dtype == "F32") {
+            memcpy(&dst[i], src + 4 * i, 4);
+        } else {
+            uint16_t h;
+            memcpy(&h, src + 2 * i, 2);
+            if (dtype == "F16") {
+                dst[i] = half_to_float(h);
+            } else {
+                uint32_t bits = (uint32_t)h << 16;
+                memcpy(&dst[i], &bits, 4);
+            }
+        }
+    }
+}
+
+// rows * cols * element bytes in *bytes; false if that overflows.
+static bool tensor_bytes(size_t rows, size_t cols, size_t element, size_t *bytes) {
+    return !__builtin_mul_overflow(rows, cols, bytes) && !__builtin_mul_overflow(*bytes, element, bytes);
+}
+
+typedef struct Tensor {
+    std::string name;
+    std::string dtype;
+    size_t rows, cols;
+    const uint8_t *data;
+} Tensor;
+
+// The 2-D tensors of a safetensors file; others are listed and skipped.
+static bool safetensors(const uint8_t *file, size_t length, const char *path, std::vector<Tensor> *out) {
+    uint64_t header = UINT64_MAX;
+    if (length >= 8) {
+        memcpy(&header, file, 8);
+    }
+    if (length < 8 || header > length - 8) {
+        fprintf(stderr, "%s: not a safetensors file\n", path);
+        return false;
+    }
+    Json root;
+    size_t error = 0;
+    if (!Json::parse((const char *)file + 8, header, &root, &error) || root.type != Json::OBJECT) {
+        fprintf(stderr, "%s: invalid header at offset %zu\n", path, 8 + error);
+        return false;
+    }
+    const uint8_t *data = file + 8 + header;
+    size_t data_length = length - 8 - header;
+    for (const auto &member : root.object) {
+        if (member.first == "__metadata__") {
+            continue;
+        }
+        const Json &info = member.second;
+        const Json *shape = info.get("shape");
+        const Json *offsets = info.get("data_offsets");
+        std::string dtype = info.get_string("dtype");
+        if (!shape || !offsets || offsets->array.size() != 2 || !offsets->array[0].is_integer ||
+            !offsets->array[1].is_integer) {
+            fprintf(stderr, "%s: invalid entry for %s\n", path, member.first.c_str());
+            return false;
+        }
+        if (shape->array.size() != 2 || dtype_bytes(dtype) == 0) {
+            printf("Skipping %s (%zu-D %s)\n", member.first.c_str(), shape->array.size(), dtype.c_str());
+            continue;
+        }
+        if (!shape->array[0].is_integer || !shape->array[1].is_integer) {
+            fprintf(stderr, "%s: invalid shape of %s\n", path, member.first.c_str());
+            return false;
+        }
+        Tensor t = {member.first, dtype, shape->array[0].integer, shape->array[1].integer, nullptr};
+        uint64_t begin = offsets->array[0].integer, end = offsets->array[1].integer;
+        size_t bytes;
+        if (!tensor_bytes(t.rows, t.cols, dtype_bytes(dtype), &bytes) || begin > end || end > data_length ||
+            end - begin != bytes) {
+            fprintf(stderr, "%s: data of %s out of range\n", path, t.name.c_str());
+            return false;
+        }
+        t.data = data + begin;
+        out->push_back(t);
+    }
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    CoreConfig config;
+    int bits = 8;
+    size_t base = 0x10000;
+    std::vector<std::string> filters;
+    std::string raw;
+    std::vector<const char *> paths;
+    for (int i = 1; i < argc; i++) {
+        bool value = i + 1 < argc;
+        if (!strcmp(argv[i], "-b") && value) {
+            bits = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "-l") && value) {
+            config.lanes = strtoul(argv[++i], NULL, 0);
+        } else if (!strcmp(argv[i], "-r") && value) {
+            config.rows = strtoul(argv[++i], NULL, 0);
+        } else if (!strcmp(argv[i], "-d") && value) {
+            config.sram_depth = strtoul(argv[++i], NULL, 0);
+        } else if (!strcmp(argv[i], "-t") && value) {
+            filters.push_back(argv[++i]);
+        } else if (!strcmp(argv[i], "-a") && value) {
+            base = strtoull(argv[++i], NULL, 0);
+        } else if (!strcmp(argv[i], "--raw") && value) {
+            raw = argv[++i];
+        } else if (argv[i][0] == '-') {
+            usage(argv[0]);
+            return 1;
+        } else {
+            paths.push_back(argv[i]);
+        }
+    }
+    if (paths.size() != 2 || (bits != 8 && bits != 4) || config.lanes == 0 || config.lanes % 8 != 0 ||
+        config.rows == 0 || config.sram_depth == 0 || base % DramStorage::PAGE_SIZE != 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    int fd = open(paths[0], O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        perror(paths[0]);
+        return 1;
+    }
+    size_t length = (size_t)st.st_size;
+    void *map = length ? mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (map == MAP_FAILED) {
+        perror(paths[0]);
+        return 1;
+    }
+    const uint8_t *file = (const uint8_t *)map;
+
+    std::vector<Tensor> tensors;
+    if (!raw.empty()) {
+        char name[256], dtype[8] = "F32";
+        size_t rows, cols;
+        if (sscanf(raw.c_str(), "%255[^:]:%zu:%zu:%7s", name, &rows, &cols, dtype) < 3 || dtype_bytes(dtype) == 0) {
+            usage(argv[0]);
+            return 1;
+        }
+        size_t bytes;
+        if (!tensor_bytes(rows, cols, dtype_bytes(dtype), &bytes) || bytes != length) {
+            fprintf(stderr, "%s: %zu bytes, expected %zu x %zu %s\n", paths[0], length, rows, cols, dtype);
+            return 1;
+        }
+        tensors.push_back({name, dtype, rows, cols, file});
+    } else if (!safetensors(file, length, paths[0], &tensors)) {
+        return 1;
+    }
+
+    WeightImageWriter writer(config, base);
+    if (!writer.open(paths[1])) {
+        return 1;
+    }
+    printf("Tensor\tRows\tCols\tBits\tBytes\tMax error\n");
+    size_t packed = 0;
+    std::vector<float> w;
+    for (const Tensor &t : tensors) {
+        bool selected = filters.empty();
+        for (const std::string &filter : filters) {
+            selected = selected || t.name.find(filter) != std::string::npos;
+        }
+        if (!selected) {
+            continue;
+        }
+        w.resize(t.rows * t.cols);
+        to_float(t.data, t.dtype, w.size(), w.data());
+        QuantTensor q = quantize(t.name, w.data(), t.rows, t.cols, bits, config.lanes);
+
+        // Largest dequantization error relative to the row's largest weight.
+        double worst = 0;
+        size_t groups = (t.cols + config.lanes - 1) / config.lanes;
+        for (size_t r = 0; r < t.rows; r++) {
+            double largest = 0, error = 0;
+            for (size_t c = 0; c < t.cols; c++) {
+                double scale = q.row_scales[r];
+                if (bits == 4) {
+                    scale *= q.group_scales[r * groups + c / config.lanes] / 256.0;
+                }
+                double x = ((int)q.q[r * t.cols + c] - q.zero_point) * scale;
+                largest = std::max(largest, (double)std::fabs(w[r * t.cols + c]));
+                error = std::max(error, std::fabs(x - w[r * t.cols + c]));
+            }
+            worst = std::max(worst, largest > 0 ? error / largest : 0);
+        }
+
+        size_t before = writer.end();
+        if (!writer.add(q)) {
+            return 1;
+        }
+        packed += writer.end() - before;
+        printf("%s\t%zu\t%zu\t%d\t%zu\t%.2f%%\n", t.name.c_str(), t.rows, t.cols, bits, writer.end() - before,
+               100 * worst);
+    }
+    if (!writer.close()) {
+        return 1;
+    }
+    munmap(map, length);
+    printf("Wrote %s.bin (%zu bytes at 0x%zx) and %s.json\n", paths[1], packed, base, paths[1]);
+    return 0;
+}
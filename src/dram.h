@@ -1,25 +1,121 @@
 #ifndef DRAM_AXI4_H
 #define DRAM_AXI4_H
 
+#include <algorithm>
 #include <cassert>
 #include <cstddef>
 #include <cstdint>
+#include <cstdio>
 #include <cstdlib>
 #include <vector>
 
+#include "dram_storage.h"
+
+/**
+ * DRAM timing parameters, in controller clock cycles.
+ * Defaults approximate an LPDDR5 channel behind a 1.4 GHz controller.
+ *
+ * Addresses are mapped as row:bank:column, with consecutive row-sized chunks
+ * rotating over the bank groups first, so linear streams spread over all banks.
+ */
+typedef struct DramTiming {
+    int bank_groups = 4;        // Number of bank groups
+    int banks_per_group = 4;    // Banks in each bank group
+    size_t row_bytes = 2048;    // Row (page) size per bank
+
+    int tRCD = 25;              // ACT to RD (18 ns)
+    int tCL = 28;               // RD to first data (20 ns)
+    int tRP = 25;               // PRE to ACT (18 ns)
+    int tRAS = 59;              // ACT to PRE (42 ns)
+    int tCCD_S = 2;             // RD to RD, different bank group
+    int tCCD_L = 4;             // RD to RD, same bank group
+    int tCWL = 15;              // WR to first write data (11 ns)
+    int tWR = 48;               // End of write data to PRE (34 ns)
+    int tWTR = 14;              // Write to read turnaround (10 ns)
+    int tRTW = 8;               // Read to write turnaround
+    int tREFI = 5460;           // Refresh interval (3.9 us), 0 disables refresh
+    int tRFC = 392;             // All-bank refresh duration (280 ns)
+
+    int bus_bytes = 32;         // Data bus width (256 bits), largest beat size
+    double clock_ghz = 1.4;     // Controller clock, for converting to GB/s
+    double max_bytes_per_ns = 45.0; // Bandwidth cap (internal bus), 0 disables
+
+    int jitter = 0;             // Extra random latency, uniform in [0, jitter]
+    uint64_t seed = 1;          // Seed for the jitter generator
+} DramTiming;
+
 /**
  * C++ dram implementation, accessed over AXI4.
  * Only supports INCR burst type.
+ *
+ * Up to max_outstanding read bursts can be in flight; arready is deasserted
+ * when all slots are taken. Bursts with different ARIDs may complete out of
+ * order, bursts with the same ARID are returned in order. Beats of a burst
+ * are never interleaved with those of another burst.
+ *
+ * Writes work the same way on the AW/W/B channels. W beats must follow the
+ * order of the AW requests, and wready stays low until the AW of the beat has
+ * been accepted. Like rdata, wdata points to the first byte of the beat and
+ * bit i of wstrb enables byte i. Write data is visible immediately, the B
+ * response follows once the DRAM write has been scheduled and completed.
+ * Reads and writes share the bandwidth cap, and switching the DRAM bus
+ * direction costs tWTR / tRTW.
  */
 class Dram {
 public:
-    // Internal storage
-    uint8_t *data;
+    // Internal storage, pages are allocated on first write.
+    DramStorage data;
     size_t size;
 
     // General
     bool clk = 0;
-    int cycle = 0; // Current cycle number
+    uint64_t cycle = 0; // Current cycle number
+
+    DramTiming timing;
+
+    static const int LATENCY_BUCKETS = 4096; // Burst latency histogram size, in cycles
+
+    typedef struct Stats {
+        uint64_t row_hits = 0;      // Burst hit the open row
+        uint64_t row_misses = 0;    // Bank was precharged, needed ACT
+        uint64_t row_conflicts = 0; // Other row open, needed PRE + ACT
+        uint64_t refreshes = 0;     // All-bank refreshes performed
+
+        uint64_t cycles = 0;        // Cycles since the last reset_stats()
+        uint64_t bytes_read = 0;    // Bytes delivered on the R channel
+        uint64_t busy_beats = 0;    // Cycles with a beat on the R channel
+        uint64_t idle_beats = 0;    // Cycles without a beat on the R channel
+        uint64_t throttled = 0;     // Idle cycles caused by the bandwidth cap
+        uint64_t stalled = 0;       // Cycles the master held rready low
+
+        uint64_t bursts = 0;        // Completed read bursts
+        uint64_t bytes_written = 0; // Bytes accepted on the W channel (strobed bytes)
+        uint64_t write_beats = 0;   // Beats accepted on the W channel
+        uint64_t write_bursts = 0;  // Write bursts completed with a B response
+        uint64_t turnarounds = 0;   // DRAM bus direction switches
+        uint64_t latency_sum = 0;   // Sum of burst latencies (AR accept to rlast)
+        uint64_t latency_hist[LATENCY_BUCKETS] = {}; // Last bucket counts overflows
+
+        double avg_latency() const {
+            return bursts ? (double)latency_sum / bursts : 0.0;
+        }
+
+        // Burst latency below which the given fraction (e.g. 0.99) of bursts fall.
+        int latency_percentile(double fraction) const {
+            uint64_t target = (uint64_t)(fraction * bursts + 0.5);
+            uint64_t count = 0;
+            for (int i = 0; i < LATENCY_BUCKETS; i++) {
+                count += latency_hist[i];
+                if (count >= target && count > 0) return i;
+            }
+            return LATENCY_BUCKETS - 1;
+        }
+
+        double bandwidth_gbps(double clock_ghz) const {
+            return cycles ? (double)bytes_read / cycles * clock_ghz : 0.0;
+        }
+    } Stats;
+    Stats stats;
 
     // Input
     typedef struct Input {
@@ -28,10 +124,25 @@ public:
         size_t arlen = 0;    // Burst length
         size_t arsize = 0;   // Size of each transfer (log2 of byte size)
         size_t arburst = 0;  // Burst type (0: FIXED, 1: INCR, 2: WRAP)
+        int arid = 0;        // Read transaction ID
 
         bool rready = true; // Data read ready
 
-        bool rst;
+        bool awvalid = false; // Write address valid
+        size_t awaddr = 0;   // Write address
+        size_t awlen = 0;    // Burst length
+        size_t awsize = 0;   // Size of each transfer (log2 of byte size)
+        size_t awburst = 0;  // Burst type (0: FIXED, 1: INCR, 2: WRAP)
+        int awid = 0;        // Write transaction ID
+
+        bool wvalid = false; // Write data valid
+        const uint8_t *wdata = nullptr; // Write data, first byte of the beat
+        uint64_t wstrb = ~0ull; // Byte enables, bit i for byte i of the beat
+        bool wlast = false;  // Last transfer in burst
+
+        bool bready = true;  // Write response ready
+
+        bool rst = false;
     } Input;
 
     Input in;
@@ -41,9 +152,17 @@ public:
         bool arready = true; // Read address ready
 
         bool rvalid = false; // Data valid
-        uint8_t *rdata = nullptr; // Read data
+        const uint8_t *rdata = nullptr; // Read data
+        int rid = 0; // Read transaction ID
         int rresp = 0; // Read response (0: OKAY, 1: EXOKAY, 2: SLVERR, 3: DECERR)
         bool rlast = false; // Last transfer in burst
+
+        bool awready = true; // Write address ready
+        bool wready = false; // Write data ready
+
+        bool bvalid = false; // Write response valid
+        int bid = 0; // Write transaction ID
+        int bresp = 0; // Write response
     } Output;
 
     Output out;
@@ -54,21 +173,287 @@ public:
         size_t burst_length; // Number of transfers in the burst
         size_t bytes_per_transfer; // Size of each transfer in bytes
         size_t transfers_remaining; // Transfers remaining in the burst
-        int completion_cycle; // Cycle when the burst will complete
+        uint64_t completion_cycle; // Cycle when the first data is available
+        uint64_t accept_cycle; // Cycle the AR handshake happened
+        uint64_t seq; // Acceptance order, for per-ID ordering
+        int id; // ARID
+        bool active; // Slot is in use
     } ReadRequest;
-    std::vector<ReadRequest> read_requests;
 
-    Dram(size_t size) {
+    // Fixed-capacity slot table, sized at construction. No allocations per cycle.
+    std::vector<ReadRequest> read_slots;
+    std::vector<int> free_slots; // Stack of free slot indices
+    int active_read = -1;        // Slot currently returning beats, -1 if none
+    uint64_t read_seq = 0;
+
+    typedef struct WriteRequest {
+        size_t address; // Address to write to
+        size_t burst_length; // Number of transfers in the burst
+        size_t bytes_per_transfer; // Size of each transfer in bytes
+        size_t transfers_received; // Beats received on the W channel
+        uint64_t completion_cycle; // Cycle when the B response can be sent
+        uint64_t seq; // Acceptance order, for per-ID ordering
+        int id; // AWID
+        bool active; // Slot is in use
+    } WriteRequest;
+
+    std::vector<WriteRequest> write_slots;
+    std::vector<int> free_write_slots;
+    std::vector<int> w_order;   // Ring of slots waiting for W data, in AW order
+    int w_head = 0;
+    int w_count = 0;
+    uint64_t write_seq = 0;
+
+    // Bank state for the timing model.
+    typedef struct Bank {
+        int64_t open_row = -1;   // Currently open row, -1 if precharged
+        uint64_t pre_cycle = 0;  // Earliest cycle for a PRE (tRAS, tWR)
+        uint64_t ready_cycle = 0; // Earliest cycle for the next command
+    } Bank;
+    std::vector<Bank> banks;
+    std::vector<uint64_t> group_col_cycle; // Last column command per bank group
+    uint64_t last_col_cycle = 0;  // Last column command on any bank
+    bool last_col_write = false;  // Direction of the last column command
+    uint64_t next_refresh = 0;    // Cycle of the next refresh
+    uint64_t refresh_done = 0;    // Cycle at which the current refresh ends
+    uint64_t rng_state;
+    double credit = 0;            // Bandwidth credit in bytes
+    double credit_per_cycle;      // Bytes added to the credit each cycle
+    uint8_t beat_buf[2][64];      // For beats crossing a storage page, alternating
+    int beat_buf_idx = 0;
+
+    Dram(size_t size, const DramTiming &timing = DramTiming(), int max_outstanding = 16)
+        : data(size), timing(timing) {
+        assert(timing.bank_groups > 0 && timing.banks_per_group > 0 && timing.row_bytes > 0);
+        assert(max_outstanding > 0);
+        read_slots.resize(max_outstanding);
+        write_slots.resize(max_outstanding);
+        w_order.resize(max_outstanding);
+        reset_slots();
+        banks.resize(timing.bank_groups * timing.banks_per_group);
+        group_col_cycle.resize(timing.bank_groups);
+        next_refresh = timing.tREFI;
+        rng_state = timing.seed ? timing.seed : 1;
+        assert(timing.bus_bytes > 0 && (timing.bus_bytes & (timing.bus_bytes - 1)) == 0);
+        assert(timing.bus_bytes <= (int)sizeof(beat_buf[0]));
+        credit_per_cycle = timing.max_bytes_per_ns > 0 ? timing.max_bytes_per_ns / timing.clock_ghz : timing.bus_bytes;
+
         this->size = size;
-        data = new uint8_t[size];
-        // Initialize memory to a known pattern.
-        for (size_t i = 0; i < size; i++) {
-            data[i] = 0xAB;
+    }
+
+    // Pointer to the bytes of a beat. Only beats crossing a page are copied.
+    const uint8_t *beat_ptr(size_t address, size_t bytes) {
+        if (DramStorage::contiguous(address, bytes) == bytes) {
+            return data.read_ptr(address);
+        }
+        // Alternate buffers, so the visible output stays valid while the next beat is prepared.
+        beat_buf_idx ^= 1;
+        data.read(address, beat_buf[beat_buf_idx], bytes);
+        return beat_buf[beat_buf_idx];
+    }
+
+    void reset_slots() {
+        free_slots.clear();
+        for (int i = (int)read_slots.size() - 1; i >= 0; i--) {
+            read_slots[i].active = false;
+            free_slots.push_back(i);
+        }
+        active_read = -1;
+        free_write_slots.clear();
+        for (int i = (int)write_slots.size() - 1; i >= 0; i--) {
+            write_slots[i].active = false;
+            free_write_slots.push_back(i);
+        }
+        w_head = 0;
+        w_count = 0;
+    }
+
+    void reset_stats() {
+        stats = Stats();
+    }
+
+    void print_stats() const {
+        printf("=== DRAM Statistics ===\n");
+        printf("   Cycles          : %llu\n", (unsigned long long)stats.cycles);
+        printf("   Bytes read      : %llu\n", (unsigned long long)stats.bytes_read);
+        printf("   Bandwidth       : %.2f GB/s (cap %.2f GB/s)\n",
+               stats.bandwidth_gbps(timing.clock_ghz), timing.max_bytes_per_ns);
+        printf("   Busy/idle beats : %llu / %llu (%llu throttled, %llu stalled)\n",
+               (unsigned long long)stats.busy_beats, (unsigned long long)stats.idle_beats,
+               (unsigned long long)stats.throttled, (unsigned long long)stats.stalled);
+        printf("   Bursts          : %llu\n", (unsigned long long)stats.bursts);
+        printf("   Latency avg/p99 : %.1f / %d cycles\n", stats.avg_latency(), stats.latency_percentile(0.99));
+        printf("   Bytes written   : %llu in %llu beats, %llu bursts (%.2f GB/s)\n",
+               (unsigned long long)stats.bytes_written, (unsigned long long)stats.write_beats,
+               (unsigned long long)stats.write_bursts,
+               stats.cycles ? (double)stats.bytes_written / stats.cycles * timing.clock_ghz : 0.0);
+        printf("   Bus turnarounds : %llu\n", (unsigned long long)stats.turnarounds);
+        printf("   Row hit/miss/conflict: %llu / %llu / %llu, refreshes: %llu\n",
+               (unsigned long long)stats.row_hits, (unsigned long long)stats.row_misses,
+               (unsigned long long)stats.row_conflicts, (unsigned long long)stats.refreshes);
+    }
+
+    int outstanding_reads() const {
+        return (int)(read_slots.size() - free_slots.size());
+    }
+
+    int outstanding_writes() const {
+        return (int)(write_slots.size() - free_write_slots.size());
+    }
+
+    /**
+     * Pick the next burst to respond to: the oldest burst that has completed
+     * and that has no older outstanding burst with the same ID.
+     */
+    template <typename T>
+    int select_oldest(const std::vector<T> &slots) const {
+        int best = -1;
+        for (int i = 0; i < (int)slots.size(); i++) {
+            const T &req = slots[i];
+            if (!req.active || cycle < req.completion_cycle) continue;
+            if (best >= 0 && slots[best].seq < req.seq) continue;
+            bool blocked = false;
+            for (const T &other : slots) {
+                if (other.active && other.id == req.id && other.seq < req.seq) {
+                    blocked = true;
+                    break;
+                }
+            }
+            if (!blocked) best = i;
+        }
+        return best;
+    }
+
+    // Deterministic xorshift64 generator, so runs with jitter are reproducible.
+    uint64_t next_random() {
+        rng_state ^= rng_state << 13;
+        rng_state ^= rng_state >> 7;
+        rng_state ^= rng_state << 17;
+        return rng_state;
+    }
+
+    /**
+     * Schedule the DRAM commands for a burst starting at the given address.
+     * For reads, return the cycle at which its first data beat is available;
+     * for writes, the cycle at which the write has completed.
+     * Commands to a bank are issued in acceptance order, but bursts to other
+     * banks may overtake them (the data bus is arbitrated when returning beats).
+     */
+    uint64_t schedule_burst(size_t address, bool write = false, size_t beats = 1) {
+        const int num_banks = (int)banks.size();
+
+        // Refresh closes all rows and blocks the device for tRFC.
+        while (timing.tREFI > 0 && cycle >= next_refresh) {
+            for (Bank &b : banks) {
+                b.open_row = -1;
+            }
+            refresh_done = next_refresh + timing.tRFC;
+            next_refresh += timing.tREFI;
+            stats.refreshes++;
+        }
+
+        size_t chunk = address / timing.row_bytes;
+        int bank_idx = (int)(chunk % num_banks);
+        int64_t row = (int64_t)(chunk / num_banks);
+        int group = bank_idx % timing.bank_groups;
+        Bank &bank = banks[bank_idx];
+
+        uint64_t t = cycle;
+        if (t < refresh_done) t = refresh_done;
+        if (t < bank.ready_cycle) t = bank.ready_cycle;
+
+        if (bank.open_row == row) {
+            stats.row_hits++;
+        } else {
+            if (bank.open_row >= 0) {
+                // Row conflict: precharge, respecting tRAS of the open row.
+                stats.row_conflicts++;
+                if (t < bank.pre_cycle) t = bank.pre_cycle;
+                t += timing.tRP;
+            } else {
+                stats.row_misses++;
+            }
+            bank.pre_cycle = t + timing.tRAS;
+            bank.open_row = row;
+            t += timing.tRCD;
+        }
+
+        // Column command spacing: tCCD_L within a bank group, tCCD_S on the shared bus. Bursts are
+        // placed out of order, so keep clear of the last command of every group, not just the latest.
+        if (t < group_col_cycle[group] + timing.tCCD_L) t = group_col_cycle[group] + timing.tCCD_L;
+        for (bool moved = true; moved;) {
+            moved = false;
+            for (uint64_t other : group_col_cycle) {
+                if (t < other + timing.tCCD_S && other < t + timing.tCCD_S) {
+                    t = other + timing.tCCD_S;
+                    moved = true;
+                }
+            }
+        }
+        // Turnaround when the bus switches between reading and writing.
+        if (write != last_col_write) {
+            uint64_t turnaround = write ? timing.tRTW : timing.tWTR;
+            if (t < last_col_cycle + turnaround) t = last_col_cycle + turnaround;
+            last_col_write = write;
+            stats.turnarounds++;
+        }
+        if (t > group_col_cycle[group]) group_col_cycle[group] = t;
+        if (t > last_col_cycle) last_col_cycle = t;
+        bank.ready_cycle = t + 1;
+
+        if (write) {
+            uint64_t done = t + timing.tCWL + beats;
+            if (bank.pre_cycle < done + timing.tWR) bank.pre_cycle = done + timing.tWR;
+            return done;
+        }
+
+        uint64_t latency = timing.tCL;
+        if (timing.jitter > 0) {
+            latency += next_random() % (uint64_t)(timing.jitter + 1);
+        }
+        return t + latency;
+    }
+
+    /**
+     * Fast-forward: the earliest cycle (the value of cycle during that rising edge) at which eval()
+     * can do more than an idle tick, if the inputs stay as they are; UINT64_MAX if nothing is
+     * pending. Before it, ticks only count cycles (and stalls) and refill the bandwidth credit.
+     */
+    uint64_t next_event_cycle() const {
+        const uint64_t now = cycle + 1;
+        if (in.rst || out.rvalid || out.bvalid || (in.arvalid && out.arready) || (in.awvalid && out.awready) ||
+            (in.wvalid && out.wready) || (in.rready && active_read >= 0)) {
+            return now;
+        }
+        uint64_t earliest = UINT64_MAX;
+        if (in.rready) {
+            for (const ReadRequest &req : read_slots) {
+                if (req.active) earliest = std::min(earliest, std::max(req.completion_cycle, now));
+            }
+        }
+        if (in.bready) {
+            for (const WriteRequest &req : write_slots) {
+                if (req.active) earliest = std::min(earliest, std::max(req.completion_cycle, now));
+            }
         }
+        return earliest;
     }
 
-    ~Dram() {
-        delete[] data;
+    /**
+     * Advance by n idle cycles at once, with the same state and statistics as n rising and
+     * falling edges. Only between cycles (clk low), and only before next_event_cycle().
+     */
+    void fast_forward(uint64_t n) {
+        assert(!clk && n < next_event_cycle() - cycle);
+        cycle += n;
+        stats.cycles += n;
+        stats.idle_beats += n;
+        if (!in.rready) stats.stalled += n;
+        // Added one cycle at a time, so the credit rounds as it would cycle by cycle.
+        for (uint64_t i = 0; i < n && credit < timing.bus_bytes; i++) {
+            credit += credit_per_cycle;
+            if (credit > timing.bus_bytes) credit = timing.bus_bytes;
+        }
     }
 
     void eval() {
@@ -81,21 +466,85 @@ public:
 
         if (in.rst) {
             next = Output();
+            reset_slots();
             return;
         }
-        if (in.arvalid) {
+        if (in.arvalid && out.arready) {
             assert(in.arburst == 1); // Only INCR burst type is supported.
-            
-            // Put read request in the queue.
-            ReadRequest req;
+            assert((1 << in.arsize) <= timing.bus_bytes); // Beat must fit on the bus.
+            assert(!free_slots.empty());
+
+            // Put read request in a free slot.
+            int slot = free_slots.back();
+            free_slots.pop_back();
+            ReadRequest &req = read_slots[slot];
             req.address = in.araddr;
             req.burst_length = in.arlen + 1; // arlen is burst length - 1
             req.bytes_per_transfer = 1 << in.arsize; // 2^arsize
             req.transfers_remaining = req.burst_length;
-            req.completion_cycle = cycle + 10 + rand()%3;
-            read_requests.push_back(req);
+            req.completion_cycle = schedule_burst(req.address);
+            req.accept_cycle = cycle;
+            req.seq = read_seq++;
+            req.id = in.arid;
+            req.active = true;
+        }
+
+        if (in.awvalid && out.awready) {
+            assert(in.awburst == 1); // Only INCR burst type is supported.
+            assert((1 << in.awsize) <= timing.bus_bytes);
+            assert(!free_write_slots.empty());
+
+            int slot = free_write_slots.back();
+            free_write_slots.pop_back();
+            WriteRequest &req = write_slots[slot];
+            req.address = in.awaddr;
+            req.burst_length = in.awlen + 1;
+            req.bytes_per_transfer = 1 << in.awsize;
+            req.transfers_received = 0;
+            req.completion_cycle = UINT64_MAX; // Until all data has arrived
+            req.seq = write_seq++;
+            req.id = in.awid;
+            req.active = true;
+            w_order[(w_head + w_count) % w_order.size()] = slot;
+            w_count++;
+        }
+
+        if (in.wvalid && out.wready) {
+            // Write data is posted: store it now, schedule the DRAM write after the last beat.
+            assert(w_count > 0);
+            WriteRequest &req = write_slots[w_order[w_head]];
+            size_t address = req.address + req.transfers_received * req.bytes_per_transfer;
+            for (size_t i = 0; i < req.bytes_per_transfer; i++) {
+                if (in.wstrb >> i & 1) {
+                    data.write8(address + i, in.wdata[i]);
+                    stats.bytes_written++;
+                }
+            }
+            credit -= req.bytes_per_transfer;
+            stats.write_beats++;
+            req.transfers_received++;
+            bool last = req.transfers_received == req.burst_length;
+            assert(in.wlast == last);
+            if (last) {
+                req.completion_cycle = schedule_burst(req.address, true, req.burst_length);
+                w_head = (w_head + 1) % w_order.size();
+                w_count--;
+            }
+        }
 
-            // Keep arready high - we always accept new read requests.
+        if (in.bready) {
+            // Write response accepted by the master.
+            next.bvalid = false;
+            int slot = select_oldest(write_slots);
+            if (slot >= 0) {
+                WriteRequest &req = write_slots[slot];
+                next.bvalid = true;
+                next.bid = req.id;
+                next.bresp = 0; // OKAY response
+                stats.write_bursts++;
+                req.active = false;
+                free_write_slots.push_back(slot);
+            }
         }
 
         if (in.rready) {
@@ -103,25 +552,58 @@ public:
             next.rvalid = false;
         }
 
-        if (in.rready && !read_requests.empty()) {
-            // Master is ready, and we have active read requests.
-            ReadRequest &req = read_requests.front();
-            if (cycle >= req.completion_cycle) {
+        // Bandwidth cap: refill the credit, at most one full beat can be banked.
+        credit += credit_per_cycle;
+        if (credit > timing.bus_bytes) credit = timing.bus_bytes;
+
+        stats.cycles++;
+        bool beat = false;
+        if (in.rready) {
+            // Master is ready. Continue the current burst, or start the next one.
+            if (active_read < 0) {
+                active_read = select_oldest(read_slots);
+            }
+            if (active_read >= 0 && credit < read_slots[active_read].bytes_per_transfer) {
+                stats.throttled++;
+            } else if (active_read >= 0) {
+                ReadRequest &req = read_slots[active_read];
+                beat = true;
+                credit -= req.bytes_per_transfer;
+                stats.bytes_read += req.bytes_per_transfer;
                 size_t address = req.address + (req.burst_length - req.transfers_remaining) * req.bytes_per_transfer;
-                next.rdata = &data[address];
+                next.rdata = beat_ptr(address, req.bytes_per_transfer);
                 next.rvalid = true;
                 next.rresp = 0; // OKAY response
+                next.rid = req.id;
 
                 req.transfers_remaining--;
                 // Check if this is the last transfer
                 if (!req.transfers_remaining) {
                     next.rlast = true;
-                    read_requests.erase(read_requests.begin()); // Remove request
+                    uint64_t latency = cycle - req.accept_cycle;
+                    stats.bursts++;
+                    stats.latency_sum += latency;
+                    stats.latency_hist[latency < LATENCY_BUCKETS ? latency : LATENCY_BUCKETS - 1]++;
+                    req.active = false;
+                    free_slots.push_back(active_read);
+                    active_read = -1;
                 } else {
                     next.rlast = false;
                 }
             }
+        } else {
+            stats.stalled++;
+        }
+        if (beat) {
+            stats.busy_beats++;
+        } else {
+            stats.idle_beats++;
         }
+
+        // Backpressure the master when all slots are taken.
+        next.arready = !free_slots.empty();
+        next.awready = !free_write_slots.empty();
+        next.wready = w_count > 0;
     }
 };
 
@@ -0,0 +1,194 @@
+#ifndef DRAM_STORAGE_H
+#define DRAM_STORAGE_H
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * Sparse backing store for the DRAM model.
+ *
+ * Memory is split in pages that are only allocated on first write. Pages that
+ * were never written read as the fill pattern, so a 4 GB instance costs almost
+ * nothing until it is used. Files (e.g. weight images) can be mapped read-only
+ * into the address space; writes to such pages are copy-on-write and never
+ * reach the file.
+ */
+class DramStorage {
+public:
+    static const size_t PAGE_SIZE = 64 * 1024;
+
+    size_t size;
+    uint8_t fill;
+
+    DramStorage(size_t size, uint8_t fill = 0xAB) : size(size), fill(fill) {
+        size_t num_pages = (size + PAGE_SIZE - 1) / PAGE_SIZE;
+        pages.resize(num_pages, nullptr);
+        owned.resize(num_pages, false);
+        fill_page.resize(PAGE_SIZE, fill);
+    }
+
+    ~DramStorage() {
+        for (size_t i = 0; i < pages.size(); i++) {
+            if (owned[i]) {
+                free(pages[i]);
+            }
+        }
+        for (const Mapping &m : mappings) {
+            munmap(m.ptr, m.length);
+        }
+    }
+
+    DramStorage(const DramStorage &) = delete;
+    DramStorage &operator=(const DramStorage &) = delete;
+
+    // Pointer for reading, valid up to the end of the page containing addr.
+    const uint8_t *read_ptr(size_t addr) const {
+        assert(addr < size);
+        const uint8_t *page = pages[addr / PAGE_SIZE];
+        return (page ? page : fill_page.data()) + addr % PAGE_SIZE;
+    }
+
+    // Pointer for writing, valid up to the end of the page. Materializes the page.
+    uint8_t *write_ptr(size_t addr) {
+        assert(addr < size);
+        size_t index = addr / PAGE_SIZE;
+        if (!pages[index]) {
+            uint8_t *page = (uint8_t *)aligned_alloc(64, PAGE_SIZE);
+            if (page == NULL) {
+                fprintf(stderr, "Memory allocation failed\n");
+                exit(1);
+            }
+            memset(page, fill, PAGE_SIZE);
+            pages[index] = page;
+            owned[index] = true;
+        }
+        return pages[index] + addr % PAGE_SIZE;
+    }
+
+    // Number of bytes in the range [addr, addr + length) that are in the same page as addr.
+    static size_t contiguous(size_t addr, size_t length) {
+        size_t left = PAGE_SIZE - addr % PAGE_SIZE;
+        return length < left ? length : left;
+    }
+
+    void read(size_t addr, void *dst, size_t length) const {
+        assert(addr + length <= size);
+        uint8_t *out = (uint8_t *)dst;
+        while (length) {
+            size_t n = contiguous(addr, length);
+            memcpy(out, read_ptr(addr), n);
+            out += n;
+            addr += n;
+            length -= n;
+        }
+    }
+
+    void write(size_t addr, const void *src, size_t length) {
+        assert(addr + length <= size);
+        const uint8_t *in = (const uint8_t *)src;
+        while (length) {
+            size_t n = contiguous(addr, length);
+            memcpy(write_ptr(addr), in, n);
+            in += n;
+            addr += n;
+            length -= n;
+        }
+    }
+
+    uint8_t read8(size_t addr) const {
+        return *read_ptr(addr);
+    }
+
+    void write8(size_t addr, uint8_t value) {
+        *write_ptr(addr) = value;
+    }
+
+    /**
+     * Map a file into the address space at addr, which must be page aligned.
+     * The file is mapped private, so writes are copy-on-write.
+     * Returns false (and prints an error) if the file can't be mapped.
+     */
+    bool map_file(const char *path, size_t addr = 0) {
+        assert(addr % PAGE_SIZE == 0);
+        int fd = open(path, O_RDONLY);
+        if (fd < 0) {
+            perror(path);
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            perror(path);
+            close(fd);
+            return false;
+        }
+        size_t length = (size_t)st.st_size;
+        if (length == 0 || addr + length > size) {
+            fprintf(stderr, "%s: file size %zu does not fit in DRAM at 0x%zx\n", path, length, addr);
+            close(fd);
+            return false;
+        }
+        void *ptr = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (ptr == MAP_FAILED) {
+            perror(path);
+            return false;
+        }
+        mappings.push_back({ptr, length});
+
+        uint8_t *base = (uint8_t *)ptr;
+        size_t full_pages = length / PAGE_SIZE;
+        for (size_t i = 0; i < full_pages; i++) {
+            size_t index = addr / PAGE_SIZE + i;
+            release(index);
+            pages[index] = base + i * PAGE_SIZE;
+        }
+        // The tail page is only partially backed by the file, copy it into a normal page.
+        size_t tail = length % PAGE_SIZE;
+        if (tail) {
+            size_t page_addr = addr + full_pages * PAGE_SIZE;
+            release(page_addr / PAGE_SIZE);
+            write(page_addr, base + full_pages * PAGE_SIZE, tail);
+        }
+        return true;
+    }
+
+    // Bytes of host memory used by materialized pages (excluding file mappings).
+    size_t resident_bytes() const {
+        size_t count = 0;
+        for (size_t i = 0; i < pages.size(); i++) {
+            count += owned[i];
+        }
+        return count * PAGE_SIZE;
+    }
+
+private:
+    typedef struct Mapping {
+        void *ptr;
+        size_t length;
+    } Mapping;
+
+    std::vector<uint8_t *> pages;  // nullptr: never written, reads as fill
+    std::vector<bool> owned;       // Page was allocated by us (vs file mapped)
+    std::vector<uint8_t> fill_page;
+    std::vector<Mapping> mappings;
+
+    void release(size_t index) {
+        if (owned[index]) {
+            free(pages[index]);
+            owned[index] = false;
+        }
+        pages[index] = nullptr;
+    }
+};
+
+#endif // DRAM_STORAGE_H
@@ -0,0 +1,216 @@
+#ifndef JSON_H
+#define JSON_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * Minimal JSON reader for safetensors headers and weight image manifests.
+ *
+ * Numbers keep their exact value as integer if they are written as one
+ * (offsets beyond 2^53 stay exact). String escapes other than \uXXXX are
+ * decoded; \uXXXX is kept as is.
+ */
+class Json {
+public:
+    enum Type { NUL, BOOL, NUMBER, STRING, ARRAY, OBJECT };
+
+    Type type = NUL;
+    bool boolean = false;
+    double number = 0;
+    uint64_t integer = 0;       // For non-negative integers
+    bool is_integer = false;
+    std::string string;
+    std::vector<Json> array;
+    std::vector<std::pair<std::string, Json>> object;   // In file order
+
+    // Member of an object, or nullptr.
+    const Json *get(const char *key) const {
+        for (const auto &member : object) {
+            if (member.first == key) {
+                return &member.second;
+            }
+        }
+        return nullptr;
+    }
+
+    // Integer member, or fallback if missing or not an integer.
+    uint64_t get_integer(const char *key, uint64_t fallback = 0) const {
+        const Json *value = get(key);
+        return value && value->is_integer ? value->integer : fallback;
+    }
+
+    std::string get_string(const char *key) const {
+        const Json *value = get(key);
+        return value && value->type == STRING ? value->string : std::string();
+    }
+
+    // Parse text[0, length). On failure returns false, with the offset of the error in *error_offset.
+    static bool parse(const char *text, size_t length, Json *out, size_t *error_offset) {
+        Parser parser{text, text + length, text};
+        bool ok = parser.value(out, 0);
+        parser.space();
+        if (ok && parser.p != parser.end) {
+            ok = false;
+        }
+        if (!ok && error_offset) {
+            *error_offset = parser.p - text;
+        }
+        return ok;
+    }
+
+private:
+    typedef struct Parser {
+        const char *begin, *end, *p;
+
+        void space() {
+            while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) {
+                p++;
+            }
+        }
+
+        bool literal(const char *word) {
+            size_t n = strlen(word);
+            if ((size_t)(end - p) < n || memcmp(p, word, n) != 0) {
+                return false;
+            }
+            p += n;
+            return true;
+        }
+
+        bool str(std::string *out) {
+            if (p >= end || *p != '"') {
+                return false;
+            }
+            p++;
+            while (p < end && *p != '"') {
+                char c = *p++;
+                if (c == '\\') {
+                    if (p >= end) {
+                        return false;
+                    }
+                    c = *p++;
+                    switch (c) {
+                        case 'n': c = '\n'; break;
+                        case 't': c = '\t'; break;
+                        case 'r': c = '\r'; break;
+                        case 'b': c = '\b'; break;
+                        case 'f': c = '\f'; break;
+                        case 'u': out->append("\\u"); continue;
+                        default: break;     // \" \\ \/
+                    }
+                }
+                out->push_back(c);
+            }
+            if (p >= end) {
+                return false;
+            }
+            p++;
+            return true;
+        }
+
+        bool value(Json *out, int depth) {
+            if (depth > 64) {
+                return false;
+            }
+            space();
+            if (p >= end) {
+                return false;
+            }
+            if (*p == '{') {
+                out->type = OBJECT;
+                p++;
+                space();
+                if (p < end && *p == '}') {
+                    p++;
+                    return true;
+                }
+                for (;;) {
+                    space();
+                    std::pair<std::string, Json> member;
+                    if (!str(&member.first)) {
+                        return false;
+                    }
+                    space();
+                    if (p >= end || *p++ != ':' || !value(&member.second, depth + 1)) {
+                        return false;
+                    }
+                    out->object.push_back(std::move(member));
+                    space();
+                    if (p < end && *p == ',') {
+                        p++;
+                    } else if (p < end && *p == '}') {
+                        p++;
+                        return true;
+                    } else {
+                        return false;
+                    }
+                }
+            }
+            if (*p == '[') {
+                out->type = ARRAY;
+                p++;
+                space();
+                if (p < end && *p == ']') {
+                    p++;
+                    return true;
+                }
+                for (;;) {
+                    out->array.emplace_back();
+                    if (!value(&out->array.back(), depth + 1)) {
+                        return false;
+                    }
+                    space();
+                    if (p < end && *p == ',') {
+                        p++;
+                    } else if (p < end && *p == ']') {
+                        p++;
+                        return true;
+                    } else {
+                        return false;
+                    }
+                }
+            }
+            if (*p == '"') {
+                out->type = STRING;
+                return str(&out->string);
+            }
+            if (literal("true") || literal("false")) {
+                out->type = BOOL;
+                out->boolean = p[-1] == 'e' && p[-2] == 'u';
+                return true;
+            }
+            if (literal("null")) {
+                out->type = NUL;
+                return true;
+            }
+            // Number: copy it out, the text isn't terminated.
+            const char *start = p;
+            while (p < end && *p && strchr("+-.0123456789eE", *p)) {
+                p++;
+            }
+            if (p == start) {
+                return false;
+            }
+            std::string digits(start, p);
+            char *rest;
+            out->type = NUMBER;
+            out->number = strtod(digits.c_str(), &rest);
+            if (*rest != '\0') {
+                return false;
+            }
+            if (digits.find_first_not_of("0123456789") == std::string::npos) {
+                out->integer = strtoull(digits.c_str(), NULL, 10);
+                out->is_integer = true;
+            }
+            return true;
+        }
+    } Parser;
+};
+
+#endif
@@ -0,0 +1,383 @@
+#ifndef REFERENCE_H
+#define REFERENCE_H
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+/**
+ * Golden model for the matmul core: the same products as the hardware, in
+ * uint32 arithmetic (wrapping like the accumulators), but fast enough for
+ * randomized checks at LLM layer shapes.
+ *
+ * Dot products run on the widest kernel the CPU supports (AVX-512 VNNI,
+ * AVX2, or scalar), picked at run time, and rows are partitioned over a
+ * shared thread pool.
+ */
+
+/**
+ * Persistent worker threads for data-parallel loops. The calling thread
+ * works along, so a pool of one thread runs everything inline.
+ */
+class ThreadPool {
+public:
+    explicit ThreadPool(unsigned threads) {
+        for (unsigned i = 1; i < threads; i++) {
+            workers.emplace_back([this] { work(); });
+        }
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stop = true;
+        }
+        wake.notify_all();
+        for (std::thread &t : workers) {
+            t.join();
+        }
+    }
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    // Pool of all hardware threads, created on first use.
+    static ThreadPool &shared() {
+        static ThreadPool pool(std::max(1u, std::thread::hardware_concurrency()));
+        return pool;
+    }
+
+    size_t size() const { return workers.size() + 1; }
+
+    /**
+     * Call fn(begin, end) for chunks of at most chunk indices covering [0, n),
+     * on all threads, and return when all are done. Loops from different
+     * threads take turns; a loop started from inside fn runs inline on the
+     * calling thread.
+     */
+    void parallel_for(size_t n, size_t chunk, const std::function<void(size_t, size_t)> &fn) {
+        assert(chunk > 0);
+        if (workers.empty() || n <= chunk || in_job()) {
+            if (n > 0) fn(0, n);
+            return;
+        }
+        std::lock_guard<std::mutex> job_lock(job_mutex); // One loop at a time
+        std::unique_lock<std::mutex> lock(mutex);
+        job = &fn;
+        job_n = n;
+        job_chunk = chunk;
+        next = 0;
+        active = workers.size();
+        generation++;
+        lock.unlock();
+        wake.notify_all();
+
+        run_chunks();
+
+        lock.lock();
+        done.wait(lock, [this] { return active == 0; });
+        job = nullptr;
+    }
+
+private:
+    // Whether this thread is running chunks of a loop (of any pool).
+    static bool &in_job() {
+        static thread_local bool running = false;
+        return running;
+    }
+
+    void run_chunks() {
+        in_job() = true;
+        for (;;) {
+            size_t begin = next.fetch_add(job_chunk);
+            if (begin >= job_n) {
+                break;
+            }
+            (*job)(begin, std::min(begin + job_chunk, job_n));
+        }
+        in_job() = false;
+    }
+
+    void work() {
+        uint64_t seen = 0;
+        std::unique_lock<std::mutex> lock(mutex);
+        for (;;) {
+            wake.wait(lock, [&] { return stop || generation != seen; });
+            if (stop) {
+                return;
+            }
+            seen = generation;
+            lock.unlock();
+            run_chunks();
+            lock.lock();
+            if (--active == 0) {
+                done.notify_one();
+            }
+        }
+    }
+
+    std::vector<std::thread> workers;
+    std::mutex job_mutex;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    const std::function<void(size_t, size_t)> *job = nullptr;
+    size_t job_n = 0;
+    size_t job_chunk = 1;
+    std::atomic<size_t> next{0};
+    uint64_t generation = 0;
+    size_t active = 0;
+    bool stop = false;
+};
+
+/**
+ * Row-major uint8 matrix in one 64-byte aligned allocation. Rows are padded
+ * with zeros to a multiple of 64 bytes, so every row starts aligned.
+ */
+class Matrix8 {
+public:
+    size_t rows;
+    size_t cols;
+    size_t stride;      // Bytes per row
+
+    Matrix8(size_t rows, size_t cols) : rows(rows), cols(cols), stride((cols + 63) & ~(size_t)63) {
+        size_t bytes = std::max<size_t>(rows * stride, 64);
+        data = static_cast<uint8_t *>(std::aligned_alloc(64, bytes));
+        if (!data) {
+            fprintf(stderr, "Matrix8: failed to allocate %zu bytes\n", bytes);
+            exit(1);
+        }
+        memset(data, 0, bytes);
+    }
+
+    // Copy of a matrix given as rows of equal length.
+    explicit Matrix8(const std::vector<std::vector<uint8_t>> &m) : Matrix8(m.size(), m.empty() ? 0 : m[0].size()) {
+        for (size_t r = 0; r < rows; r++) {
+            assert(m[r].size() == cols);
+            memcpy(row(r), m[r].data(), cols);
+        }
+    }
+
+    ~Matrix8() { std::free(data); }
+
+    Matrix8(const Matrix8 &) = delete;
+    Matrix8 &operator=(const Matrix8 &) = delete;
+
+    uint8_t *row(size_t r) { return data + r * stride; }
+    const uint8_t *row(size_t r) const { return data + r * stride; }
+
+private:
+    uint8_t *data;
+};
+
+/**
+ * Matrix of unsigned 4-bit weights, two per byte (low nibble first, the
+ * layout of the core), with a 16-bit scale per row and group of columns.
+ * Rows are padded like Matrix8.
+ */
+class Matrix4 {
+public:
+    size_t rows;
+    size_t cols;
+    size_t group;       // Columns per scale
+    size_t groups;      // Scales per row
+    Matrix8 packed;     // rows x (cols + 1) / 2 bytes
+    std::vector<uint16_t> scales;
+
+    Matrix4(size_t rows, size_t cols, size_t group)
+        : rows(rows), cols(cols), group(group), groups((cols + group - 1) / group),
+          packed(rows, (cols + 1) / 2), scales(rows * groups, 0) {}
+
+    uint8_t get(size_t r, size_t c) const { return (packed.row(r)[c / 2] >> (4 * (c % 2))) & 0xF; }
+
+    void set(size_t r, size_t c, uint8_t q) {
+        assert(q < 16);
+        uint8_t &b = packed.row(r)[c / 2];
+        b = (uint8_t)((b & (0xF0 >> (4 * (c % 2)))) | (q << (4 * (c % 2))));
+    }
+
+    uint16_t &scale(size_t r, size_t g) { return scales[r * groups + g]; }
+    uint16_t scale(size_t r, size_t g) const { return scales[r * groups + g]; }
+};
+
+// Sum of a[i] * b[i] over n bytes, modulo 2^32.
+typedef uint32_t (*DotKernel)(const uint8_t *a, const uint8_t *b, size_t n);
+
+typedef struct DotImpl {
+    const char *name;
+    DotKernel fn;
+} DotImpl;
+
+inline uint32_t dot_scalar(const uint8_t *a, const uint8_t *b, size_t n) {
+    uint32_t sum = 0;
+    for (size_t i = 0; i < n; i++) {
+        sum += (uint32_t)a[i] * b[i];
+    }
+    return sum;
+}
+
+#if defined(__x86_64__)
+// Zero extend to 16 bits, and add pairs of products into 32-bit lanes.
+__attribute__((target("avx2")))
+inline uint32_t dot_avx2(const uint8_t *a, const uint8_t *b, size_t n) {
+    __m256i acc = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256i va = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(a + i)));
+        __m256i vb = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(b + i)));
+        acc = _mm256_add_epi32(acc, _mm256_madd_epi16(va, vb));
+    }
+    __m128i s = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0x4E));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0xB1));
+    return (uint32_t)_mm_cvtsi128_si32(s) + dot_scalar(a + i, b + i, n - i);
+}
+
+// vpdpbusd multiplies unsigned by signed bytes: with b' = b - 128 (b ^ 0x80),
+// a . b = a . b' + 128 * sum(a), and sum(a) is a . 1. The last chunk is a
+// masked load, so short vectors (the 32-column groups of gemv_q4) stay on VNNI.
+__attribute__((target("avx512f,avx512bw,avx512vnni")))
+inline uint32_t dot_avx512vnni(const uint8_t *a, const uint8_t *b, size_t n) {
+    const __m512i bias = _mm512_set1_epi8((char)0x80);
+    const __m512i ones = _mm512_set1_epi8(1);
+    __m512i acc = _mm512_setzero_si512();
+    __m512i sum = _mm512_setzero_si512();
+    for (size_t i = 0; i < n; i += 64) {
+        __mmask64 mask = n - i >= 64 ? ~(__mmask64)0 : ((__mmask64)1 << (n - i)) - 1;
+        __m512i va = _mm512_maskz_loadu_epi8(mask, a + i);
+        __m512i vb = _mm512_xor_si512(_mm512_maskz_loadu_epi8(mask, b + i), bias);
+        acc = _mm512_dpbusd_epi32(acc, va, vb);
+        sum = _mm512_dpbusd_epi32(sum, va, ones);
+    }
+    alignas(64) uint32_t lanes[2][16];
+    _mm512_store_si512(lanes[0], acc);
+    _mm512_store_si512(lanes[1], sum);
+    uint32_t dot = 0;
+    for (int l = 0; l < 16; l++) {
+        dot += lanes[0][l] + 128u * lanes[1][l];
+    }
+    return dot;
+}
+#endif
+
+// Kernels this CPU can run, slowest first.
+inline std::vector<DotImpl> dot_kernels() {
+    std::vector<DotImpl> kernels = {{"scalar", dot_scalar}};
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        kernels.push_back({"avx2", dot_avx2});
+    }
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") &&
+        __builtin_cpu_supports("avx512vnni")) {
+        kernels.push_back({"avx512vnni", dot_avx512vnni});
+    }
+#endif
+    return kernels;
+}
+
+inline const DotImpl &best_dot_kernel() {
+    static const DotImpl best = dot_kernels().back();
+    return best;
+}
+
+// Rows per thread pool chunk: enough work per chunk to hide the scheduling.
+inline size_t row_chunk(size_t cols) {
+    return std::max<size_t>(1, (size_t)(1 << 16) / std::max<size_t>(cols, 1));
+}
+
+/**
+ * y = m x, for x of m.cols elements.
+ */
+inline void gemv(const Matrix8 &m, const uint8_t *x, uint32_t *y, DotKernel dot = nullptr) {
+    if (!dot) dot = best_dot_kernel().fn;
+    ThreadPool::shared().parallel_for(m.rows, row_chunk(m.cols), [&](size_t begin, size_t end) {
+        for (size_t r = begin; r < end; r++) {
+            y[r] = dot(m.row(r), x, m.cols);
+        }
+    });
+}
+
+/**
+ * y[b] = m x[b] for each row b of xs (a batch of vectors): y is xs.rows x m.rows.
+ * Each matrix row is used for the whole batch while it is in cache.
+ */
+inline void gemm(const Matrix8 &m, const Matrix8 &xs, uint32_t *y, DotKernel dot = nullptr) {
+    assert(xs.cols == m.cols);
+    if (!dot) dot = best_dot_kernel().fn;
+    ThreadPool::shared().parallel_for(m.rows, row_chunk(m.cols * xs.rows), [&](size_t begin, size_t end) {
+        for (size_t r = begin; r < end; r++) {
+            for (size_t b = 0; b < xs.rows; b++) {
+                y[b * m.rows + r] = dot(m.row(r), xs.row(b), m.cols);
+            }
+        }
+    });
+}
+
+/**
+ * y = m^T p, for p of m.rows elements (the transposed core). Columns are
+ * partitioned over the threads; the inner loop is left to the compiler to
+ * vectorize.
+ */
+inline void gemv_t(const Matrix8 &m, const uint8_t *p, uint32_t *y) {
+    const size_t block = 256;
+    ThreadPool::shared().parallel_for((m.cols + block - 1) / block, 1, [&](size_t begin, size_t end) {
+        size_t c0 = begin * block;
+        size_t c1 = std::min(end * block, m.cols);
+        std::fill(y + c0, y + c1, 0);
+        for (size_t t = 0; t < m.rows; t++) {
+            const uint8_t *row = m.row(t);
+            uint32_t scale = p[t];
+            for (size_t c = c0; c < c1; c++) {
+                y[c] += scale * row[c];
+            }
+        }
+    });
+}
+
+/**
+ * y = m x for 4-bit weights: each group's dot product d adds
+ * (d * scale + 2^(shift-1)) >> shift, as in the core (no rounding for a
+ * shift of 0). Rows are unpacked to bytes, then use the 8-bit kernel per group.
+ */
+inline void gemv_q4(const Matrix4 &m, const uint8_t *x, uint32_t *y, int shift, DotKernel dot = nullptr) {
+    assert(shift >= 0 && shift < 64);
+    if (!dot) dot = best_dot_kernel().fn;
+    const uint64_t half = shift > 0 ? (uint64_t)1 << (shift - 1) : 0;
+    ThreadPool::shared().parallel_for(m.rows, row_chunk(m.cols), [&](size_t begin, size_t end) {
+        std::vector<uint8_t> q(m.cols);
+        for (size_t r = begin; r < end; r++) {
+            const uint8_t *packed = m.packed.row(r);
+            for (size_t c = 0; c + 1 < m.cols; c += 2) {
+                q[c] = packed[c / 2] & 0xF;
+                q[c + 1] = packed[c / 2] >> 4;
+            }
+            if (m.cols % 2) {
+                q[m.cols - 1] = packed[m.cols / 2] & 0xF;
+            }
+            uint32_t sum = 0;
+            for (size_t g = 0; g < m.groups; g++) {
+                size_t c = g * m.group;
+                uint64_t d = dot(&q[c], x + c, std::min(m.group, m.cols - c));
+                sum += (uint32_t)((d * m.scale(r, g) + half) >> shift);
+            }
+            y[r] = sum;
+        }
+    });
+}
+
+#endif // REFERENCE_H
@@ -0,0 +1,430 @@
+#ifndef RUNTIME_H
+#define RUNTIME_H
+
+#include <algorithm>
+#include <cassert>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "dram.h"
+
+/**
+ * Host runtime for one matmul core (dense, 8-bit weights).
+ *
+ * Matrices are uploaded once to the core's DRAM, split in tiles that fit the
+ * hardware: at most sram_depth words of columns (the vector SRAM) and max_dim
+ * rows (the dimension registers). gemm() then queues one descriptor per tile
+ * and batch of vectors, and returns a future. A device thread runs the queue
+ * on the backend: it stages the vectors in DRAM, loads the vector of the next
+ * descriptor into the fill bank while the current one computes, and adds up
+ * the partial results of the column tiles.
+ *
+ * A backend is a core with its DMAs and DRAM, only used from the device thread:
+ *
+ *   Dram &dram();
+ *   void load_vector(size_t addr, size_t bytes);   // Vector DMA into the fill bank
+ *   bool vector_busy();
+ *   void swap();                                    // Exchange the banks (core idle)
+ *   void start(size_t addr, size_t bytes, size_t vdim, size_t hdim);  // Matrix DMA and core
+ *   bool step(std::vector<uint32_t> &group);        // Advance; true with a row group's results
+ *   uint64_t cycle();
+ *
+ * load_vector(), swap() and start() take effect at the next step(). A group
+ * holds the results of rows*batch dot products, in the order row*batch+b.
+ */
+
+// Shape of the core; must match the parameters of the RTL.
+typedef struct CoreConfig {
+    size_t lanes = 32;          // Elements per vector SRAM word and matrix row beat
+    size_t rows = 1;            // Rows per matrix beat
+    size_t batch = 1;           // Vectors per SRAM word
+    size_t sram_depth = 1024;   // Vector SRAM words
+    size_t max_dim = 65535;     // Largest vdim and hdim (DIM_WIDTH bits)
+
+    size_t word_bytes() const { return batch * lanes; }
+    size_t max_cols() const { return std::min(sram_depth * lanes, max_dim); }
+    size_t max_rows() const { return max_dim / rows * rows; }
+} CoreConfig;
+
+/**
+ * Rows [row0, row0+vdim) and columns [col0, col0+hdim) of a matrix, in the layout
+ * the core expects: rows in beats of lanes elements, padded with zeros, with groups
+ * of config.rows rows interleaved beat by beat. The last group is padded with zero rows.
+ */
+inline std::vector<uint8_t> pack_tile(const CoreConfig &config, const std::vector<std::vector<uint8_t>> &matrix,
+                                      size_t row0, size_t vdim, size_t col0, size_t hdim) {
+    size_t beats = (hdim + config.lanes - 1) / config.lanes;
+    size_t groups = (vdim + config.rows - 1) / config.rows;
+    std::vector<uint8_t> packed(groups * beats * config.rows * config.lanes, 0);
+    for (size_t row = 0; row < vdim; row++) {
+        const uint8_t *src = &matrix[row0 + row][col0];
+        for (size_t beat = 0; beat < beats; beat++) {
+            size_t col = beat * config.lanes;
+            size_t n = std::min(hdim - col, config.lanes);
+            size_t offset = ((row / config.rows * beats + beat) * config.rows + row % config.rows) * config.lanes;
+            memcpy(&packed[offset], src + col, n);
+        }
+    }
+    return packed;
+}
+
+/**
+ * Columns [col0, col0+hdim) of up to config.batch vectors in SRAM words: word n holds
+ * lanes elements of each vector, in order. Padded with zeros, also for missing vectors.
+ */
+inline std::vector<uint8_t> pack_tile_vectors(const CoreConfig &config, const std::vector<const uint8_t *> &vectors,
+                                              size_t col0, size_t hdim) {
+    assert(!vectors.empty() && vectors.size() <= config.batch);
+    size_t words = (hdim + config.lanes - 1) / config.lanes;
+    std::vector<uint8_t> packed(words * config.word_bytes(), 0);
+    for (size_t b = 0; b < vectors.size(); b++) {
+        for (size_t word = 0; word < words; word++) {
+            size_t col = word * config.lanes;
+            size_t n = std::min(hdim - col, config.lanes);
+            memcpy(&packed[(word * config.batch + b) * config.lanes], vectors[b] + col0 + col, n);
+        }
+    }
+    return packed;
+}
+
+// A matrix in device DRAM. Tile (r, c) covers rows [r*tile_rows, ...) and columns
+// [c*tile_cols, ...); the last tiles in each direction may be smaller.
+typedef struct DeviceMatrix {
+    size_t rows = 0, cols = 0;
+    size_t tile_rows = 0, tile_cols = 0;
+    size_t row_tiles = 0, col_tiles = 0;
+    std::vector<size_t> addr, bytes;    // Per tile, at r*col_tiles + c
+
+    size_t tile_vdim(size_t r) const { return std::min(tile_rows, rows - r * tile_rows); }
+    size_t tile_hdim(size_t c) const { return std::min(tile_cols, cols - c * tile_cols); }
+} DeviceMatrix;
+
+typedef struct GemmResult {
+    std::vector<std::vector<uint32_t>> y;   // y[v][row] for each vector v
+    uint64_t submit_cycle = 0;              // Device cycle when its tiles were queued
+    uint64_t start_cycle = 0;               // When its first tile started
+    uint64_t done_cycle = 0;                // When its last result arrived
+} GemmResult;
+
+template <typename Backend>
+class Runtime {
+public:
+    typedef struct Stats {
+        uint64_t descriptors = 0;       // Tiles run
+        uint64_t vector_loads = 0;      // Vector DMA loads
+        uint64_t overlapped_loads = 0;  // Of which started during the compute of a tile
+        uint64_t vector_wait = 0;       // Cycles waiting for a vector load with the core idle
+        uint64_t busy = 0;              // Cycles from the start of a tile to its last result
+    } Stats;
+
+    /**
+     * Weights are placed from dram_base up, staged vectors in the last staging_bytes
+     * of the DRAM. Uploads and jobs may come from any thread.
+     */
+    Runtime(Backend &backend, const CoreConfig &config, size_t dram_base = 0x10000, size_t staging_bytes = 16 << 20)
+        : backend(backend), config(config), weights_next(dram_base) {
+        size_t size = backend.dram().size;
+        if (staging_bytes > size || dram_base > size - staging_bytes || staging_bytes < tile_vector_bytes()) {
+            fprintf(stderr, "Runtime: DRAM of %zu bytes too small\n", size);
+            exit(1);
+        }
+        staging_base = size - staging_bytes;
+        staging_end = size;
+        staging_next = staging_base;
+        device = std::thread([this]() { run(); });
+    }
+
+    // Finishes the queued jobs.
+    ~Runtime() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stop = true;
+        }
+        wake.notify_all();
+        device.join();
+    }
+
+    /**
+     * Pack and place a matrix (rows of equal length) in DRAM, each tile on a 4 KB
+     * boundary. Runs on the device thread between tiles, and returns when done.
+     */
+    DeviceMatrix upload(const std::vector<std::vector<uint8_t>> &matrix) {
+        assert(!matrix.empty() && !matrix[0].empty());
+        auto promise = std::make_shared<std::promise<DeviceMatrix>>();
+        std::future<DeviceMatrix> future = promise->get_future();
+        post([this, &matrix, promise]() {
+            DeviceMatrix m;
+            m.rows = matrix.size();
+            m.cols = matrix[0].size();
+            m.tile_rows = config.max_rows();
+            m.tile_cols = config.max_cols() / config.lanes * config.lanes;
+            m.row_tiles = (m.rows + m.tile_rows - 1) / m.tile_rows;
+            m.col_tiles = (m.cols + m.tile_cols - 1) / m.tile_cols;
+            for (const auto &row : matrix) {
+                assert(row.size() == m.cols);
+            }
+            for (size_t r = 0; r < m.row_tiles; r++) {
+                for (size_t c = 0; c < m.col_tiles; c++) {
+                    std::vector<uint8_t> packed =
+                        pack_tile(config, matrix, r * m.tile_rows, m.tile_vdim(r), c * m.tile_cols, m.tile_hdim(c));
+                    if (packed.size() > staging_base - weights_next || packed.size() > UINT32_MAX) {
+                        fprintf(stderr, "Runtime: out of DRAM for a %zux%zu matrix\n", m.rows, m.cols);
+                        exit(1);
+                    }
+                    backend.dram().data.write(weights_next, packed.data(), packed.size());
+                    m.addr.push_back(weights_next);
+                    m.bytes.push_back(packed.size());
+                    weights_next += (packed.size() + 4095) & ~(size_t)4095;
+                }
+            }
+            promise->set_value(m);
+        });
+        return future.get();
+    }
+
+    // y = m * x for each vector x, which must have m.cols elements and stay alive until the result is ready.
+    std::future<GemmResult> gemm(const DeviceMatrix &m, const std::vector<const uint8_t *> &xs) {
+        assert(!xs.empty());
+        std::shared_ptr<Job> job = std::make_shared<Job>();
+        job->matrix = m;
+        job->xs = xs;
+        job->result.y.assign(xs.size(), std::vector<uint32_t>(m.rows, 0));
+        std::future<GemmResult> future = job->promise.get_future();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs.push_back(job);
+        }
+        wake.notify_all();
+        return future;
+    }
+
+    std::future<GemmResult> gemv(const DeviceMatrix &m, const uint8_t *x) {
+        return gemm(m, std::vector<const uint8_t *>{x});
+    }
+
+    // Copy of the statistics; consistent once all futures are ready.
+    Stats stats() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return stats_;
+    }
+
+private:
+    typedef struct Job {
+        DeviceMatrix matrix;
+        std::vector<const uint8_t *> xs;
+        GemmResult result;
+        std::promise<GemmResult> promise;
+        size_t remaining = 0;           // Descriptors not finished
+        bool started = false;
+    } Job;
+
+    // Multiply one matrix tile with the vector words staged for one batch.
+    typedef struct Descriptor {
+        size_t matrix_addr, matrix_bytes;
+        size_t vdim, hdim;
+        size_t vector_addr, vector_bytes;
+        size_t row0;                    // First row of the tile
+        size_t v0, vectors;             // Vectors [v0, v0+vectors) of the job
+        std::shared_ptr<Job> job;
+    } Descriptor;
+
+    Backend &backend;
+    CoreConfig config;
+    size_t weights_next;
+    size_t staging_base, staging_end, staging_next;
+
+    std::mutex mutex;                   // Guards commands, jobs, stop and stats_
+    std::condition_variable wake;
+    std::deque<std::function<void()>> commands;
+    std::deque<std::shared_ptr<Job>> jobs;
+    bool stop = false;
+    Stats stats_;
+    std::thread device;
+
+    // Device thread only
+    std::deque<Descriptor> queue;
+    size_t active_vector = SIZE_MAX;    // Staged address of the vector in the compute bank
+    size_t fill_vector = SIZE_MAX;      // And in the fill bank
+    bool loading = false;               // Vector DMA issued since the last swap
+
+    size_t tile_vector_bytes() const {
+        return config.sram_depth * config.word_bytes();
+    }
+
+    void post(std::function<void()> command) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            commands.push_back(std::move(command));
+        }
+        wake.notify_all();
+    }
+
+    void run() {
+        for (;;) {
+            std::unique_ptr<std::function<void()>> command;
+            std::shared_ptr<Job> job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                if (queue.empty()) {
+                    wake.wait(lock, [&]() { return stop || !commands.empty() || !jobs.empty(); });
+                }
+                if (!commands.empty()) {
+                    command.reset(new std::function<void()>(std::move(commands.front())));
+                    commands.pop_front();
+                } else if (!jobs.empty() && (queue.empty() || fits_staging(*jobs.front()))) {
+                    job = jobs.front();
+                    jobs.pop_front();
+                } else if (queue.empty() && stop) {
+                    return;
+                }
+            }
+            if (command) {
+                (*command)();
+            } else if (job) {
+                expand(job);
+            } else {
+                run_descriptor();
+            }
+        }
+    }
+
+    size_t staging_needed(const Job &job) const {
+        size_t batches = (job.xs.size() + config.batch - 1) / config.batch;
+        size_t bytes = 0;
+        for (size_t c = 0; c < job.matrix.col_tiles; c++) {
+            size_t words = (job.matrix.tile_hdim(c) + config.lanes - 1) / config.lanes;
+            bytes += batches * ((words * config.word_bytes() + 4095) & ~(size_t)4095);
+        }
+        return bytes;
+    }
+
+    bool fits_staging(const Job &job) const {
+        return staging_needed(job) <= staging_end - staging_next;
+    }
+
+    /**
+     * Stage the vectors of a job and queue its descriptors, batch by batch and column
+     * tile by column tile, so that consecutive row tiles share the loaded vector.
+     * Staging restarts at the bottom once the queue is empty.
+     */
+    void expand(const std::shared_ptr<Job> &job) {
+        const DeviceMatrix &m = job->matrix;
+        if (queue.empty()) {
+            staging_next = staging_base;
+            active_vector = fill_vector = SIZE_MAX;
+        }
+        if (!fits_staging(*job)) {
+            fprintf(stderr, "Runtime: %zu vectors of %zu elements don't fit the staging area\n",
+                    job->xs.size(), m.cols);
+            exit(1);
+        }
+        job->result.submit_cycle = backend.cycle();
+        for (size_t v0 = 0; v0 < job->xs.size(); v0 += config.batch) {
+            size_t n = std::min(config.batch, job->xs.size() - v0);
+            std::vector<const uint8_t *> xs(job->xs.begin() + v0, job->xs.begin() + v0 + n);
+            for (size_t c = 0; c < m.col_tiles; c++) {
+                std::vector<uint8_t> words = pack_tile_vectors(config, xs, c * m.tile_cols, m.tile_hdim(c));
+                size_t vector_addr = staging_next;
+                backend.dram().data.write(vector_addr, words.data(), words.size());
+                staging_next += (words.size() + 4095) & ~(size_t)4095;
+                for (size_t r = 0; r < m.row_tiles; r++) {
+                    size_t t = r * m.col_tiles + c;
+                    queue.push_back({m.addr[t], m.bytes[t], m.tile_vdim(r), m.tile_hdim(c),
+                                     vector_addr, words.size(), r * m.tile_rows, v0, n, job});
+                    job->remaining++;
+                }
+            }
+        }
+    }
+
+    void load_vector(const Descriptor &d, bool overlapped) {
+        backend.load_vector(d.vector_addr, d.vector_bytes);
+        fill_vector = d.vector_addr;
+        loading = true;
+        std::lock_guard<std::mutex> lock(mutex);
+        stats_.vector_loads++;
+        stats_.overlapped_loads += overlapped;
+    }
+
+    // Step while the core has nothing to output.
+    void idle_step(std::vector<uint32_t> &group) {
+        bool result = backend.step(group);
+        assert(!result);
+        (void)result;
+    }
+
+    // Run the descriptor at the front of the queue to completion.
+    void run_descriptor() {
+        Descriptor d = queue.front();
+        queue.pop_front();
+        std::vector<uint32_t> group;
+
+        // Bring its vector to the compute bank, unless it is there already.
+        if (active_vector != d.vector_addr) {
+            if (fill_vector != d.vector_addr) {
+                load_vector(d, false);
+            }
+            uint64_t wait_start = backend.cycle();
+            if (loading) {
+                // The load strobe needs a step before busy shows.
+                do {
+                    idle_step(group);
+                } while (backend.vector_busy());
+            }
+            backend.swap();
+            idle_step(group);
+            std::swap(active_vector, fill_vector);
+            loading = false;
+            std::lock_guard<std::mutex> lock(mutex);
+            stats_.vector_wait += backend.cycle() - wait_start;
+        }
+
+        // Start the tile, and prefetch the vector of the next one if it differs.
+        backend.start(d.matrix_addr, d.matrix_bytes, d.vdim, d.hdim);
+        if (!queue.empty() && queue.front().vector_addr != active_vector &&
+            queue.front().vector_addr != fill_vector) {
+            load_vector(queue.front(), true);
+        }
+        uint64_t start_cycle = backend.cycle();
+        if (!d.job->started) {
+            d.job->started = true;
+            d.job->result.start_cycle = start_cycle;
+        }
+
+        size_t groups = (d.vdim + config.rows - 1) / config.rows;
+        std::vector<std::vector<uint32_t>> &y = d.job->result.y;
+        for (size_t g = 0; g < groups;) {
+            if (!backend.step(group)) {
+                continue;
+            }
+            assert(group.size() == config.rows * config.batch);
+            for (size_t r = 0; r < config.rows && g * config.rows + r < d.vdim; r++) {
+                for (size_t b = 0; b < d.vectors; b++) {
+                    y[d.v0 + b][d.row0 + g * config.rows + r] += group[r * config.batch + b];
+                }
+            }
+            g++;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        stats_.descriptors++;
+        stats_.busy += backend.cycle() - start_cycle;
+        if (--d.job->remaining == 0) {
+            d.job->result.done_cycle = backend.cycle();
+            d.job->promise.set_value(std::move(d.job->result));
+        }
+    }
+};
+
+#endif
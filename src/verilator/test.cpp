@@ -1,9 +1,781 @@
 #include "Vmatmul_tb.h"
 #include "verilated.h"
+#include "dram.h"
+#include "reference.h"
+#include "runtime.h"
+#include "weight_image.h"
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <condition_variable>
 #include <cstdio>
+#include <cstring>
+#include <future>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
 #include <vector>
 
+// Elements per vector SRAM word, rows per matrix beat, and vectors per SRAM word.
+// Must match the LANES, ROWS and BATCH parameters of the RTL.
+#ifndef LANES
+#define LANES 32
+#endif
+#ifndef ROWS
+#define ROWS 1
+#endif
+#ifndef BATCH
+#define BATCH 1
+#endif
+// 2:4 sparse weights, with vector SRAM words of 2 * LANES elements. Must match the SPARSE parameter.
+#ifndef SPARSE
+#define SPARSE 0
+#endif
+#define VEC_LANES (LANES * (SPARSE + 1))
+#define WORD_BYTES (BATCH * VEC_LANES)
+// Bits per weight: 8, or 4 for group quantized weights with 16-bit scales. Must match the WEIGHT_BITS parameter.
+#ifndef WEIGHT_BITS
+#define WEIGHT_BITS 8
+#endif
+#define SCALE_SHIFT 8
+// Words per vector SRAM bank. Must match the SRAM_DEPTH parameter of matmul_tb.
+#ifndef SRAM_DEPTH
+#define SRAM_DEPTH 1024
+#endif
+
+// Per-result logging of the small demo, compiled in with -CFLAGS -DHARNESS_LOG.
+#ifdef HARNESS_LOG
+#define LOG(...) printf(__VA_ARGS__)
+#else
+#define LOG(...) do {} while (0)
+#endif
+
+// Set an input port from its width in bytes.
+template <typename T>
+static void set_port(T &port, const uint8_t *bytes, size_t length) {
+    assert(length == sizeof(T));
+    T value;
+    memcpy(&value, bytes, sizeof(T));
+    port = value;
+}
+
+template <std::size_t N>
+static void set_port(VlWide<N> &port, const uint8_t *bytes, size_t length) {
+    assert(length == N * 4);
+    for (std::size_t i = 0; i < N; i++) {
+        uint32_t word;
+        memcpy(&word, bytes + 4 * i, 4);
+        port[i] = word;
+    }
+}
+
+// Append the 32-bit words of an output port to out, lowest first.
+template <typename T>
+static void get_port(const T &port, std::vector<uint32_t> &out) {
+    for (size_t i = 0; i < sizeof(T) / 4; i++) {
+        out.push_back((uint32_t)((uint64_t)port >> (32 * i)));
+    }
+}
+
+template <std::size_t N>
+static void get_port(const VlWide<N> &port, std::vector<uint32_t> &out) {
+    for (std::size_t i = 0; i < N; i++) {
+        out.push_back(port[i]);
+    }
+}
+
+static int row_beats(size_t hdim) {
+    return (hdim + VEC_LANES - 1) / VEC_LANES;
+}
+
+/**
+ * Matrix in the layout the core expects. Rows are split in beats of LANES elements, padded with zeros.
+ * Groups of ROWS rows are interleaved: the n-th beat of a group holds beat n of each of its rows, in order.
+ * The last group is padded with zero rows.
+ */
+static std::vector<uint8_t> pack_matrix(const std::vector<std::vector<uint8_t>>& matrix, size_t hdim) {
+    size_t beats = row_beats(hdim);
+    size_t groups = (matrix.size() + ROWS - 1) / ROWS;
+    std::vector<uint8_t> packed(groups * beats * ROWS * LANES, 0);
+    for (size_t row = 0; row < matrix.size(); row++) {
+        size_t group = row / ROWS;
+        for (size_t beat = 0; beat < beats; beat++) {
+            size_t col = beat * LANES;
+            size_t n = hdim - col < LANES ? hdim - col : LANES;
+            size_t offset = ((group * beats + beat) * ROWS + row % ROWS) * LANES;
+            memcpy(&packed[offset], &matrix[row][col], n);
+        }
+    }
+    return packed;
+}
+
+/**
+ * Up to BATCH vectors of the same size in SRAM words: word n holds elements [n*VEC_LANES, (n+1)*VEC_LANES)
+ * of each vector, in order. Padded with zeros, also for missing vectors.
+ */
+static std::vector<uint8_t> pack_vectors(const std::vector<std::vector<uint8_t>>& vectors) {
+    assert(!vectors.empty() && vectors.size() <= BATCH);
+    size_t hdim = vectors[0].size();
+    size_t words = row_beats(hdim);
+    std::vector<uint8_t> packed(words * WORD_BYTES, 0);
+    for (size_t b = 0; b < vectors.size(); b++) {
+        assert(vectors[b].size() == hdim);
+        for (size_t word = 0; word < words; word++) {
+            size_t col = word * VEC_LANES;
+            size_t n = hdim - col < VEC_LANES ? hdim - col : VEC_LANES;
+            memcpy(&packed[(word * BATCH + b) * VEC_LANES], &vectors[b][col], n);
+        }
+    }
+    return packed;
+}
+
+static std::vector<uint8_t> pack_vector(const std::vector<uint8_t>& vector) {
+    return pack_vectors({vector});
+}
+
+// Append the results of a group of rows to results[b], for each vector b of the batch.
+template <typename T>
+static void get_results(const T &port, std::vector<std::vector<uint32_t>> &results) {
+    std::vector<uint32_t> words;
+    get_port(port, words);
+    assert(words.size() == ROWS * BATCH && results.size() == BATCH);
+    for (size_t r = 0; r < ROWS; r++) {
+        for (size_t b = 0; b < BATCH; b++) {
+            results[b].push_back(words[r * BATCH + b]);
+        }
+    }
+}
+
+// Append the results of a group of rows for the first vector of the batch.
+template <typename T>
+static void get_results(const T &port, std::vector<uint32_t> &results) {
+    std::vector<std::vector<uint32_t>> batch(BATCH);
+    get_results(port, batch);
+    results.insert(results.end(), batch[0].begin(), batch[0].end());
+}
+
+// Connect the AXI4 read channels of the DUT to the DRAM model.
+static void connect(Vmatmul_tb *dut, Dram &dram) {
+    dram.in.arvalid = dut->m_axi_arvalid;
+    dram.in.araddr = dut->m_axi_araddr;
+    dram.in.arlen = dut->m_axi_arlen;
+    dram.in.arsize = dut->m_axi_arsize;
+    dram.in.arburst = dut->m_axi_arburst;
+    dram.in.arid = dut->m_axi_arid;
+    dram.in.rready = dut->m_axi_rready;
+
+    dut->m_axi_arready = dram.out.arready;
+    dut->m_axi_rvalid = dram.out.rvalid;
+    dut->m_axi_rid = dram.out.rid;
+    dut->m_axi_rlast = dram.out.rlast;
+    if (dram.out.rvalid) {
+        for (int i = 0; i < 8; i++) {
+            uint32_t word;
+            memcpy(&word, dram.out.rdata + 4 * i, 4);
+            dut->m_axi_rdata[i] = word;
+        }
+    }
+}
+
+// Connect the DUT to the DRAM model, and advance both by one cycle.
+static void clock_cycle(Vmatmul_tb *dut, Dram &dram) {
+    connect(dut, dram);
+    dut->clk = 1; dut->eval();
+    dram.clk = 1; dram.eval();
+    dut->clk = 0; dut->eval();
+    dram.clk = 0; dram.eval();
+}
+
+// Performance counters of the core, in register order (see rtl/matmul.v).
+typedef struct PerfCounters {
+    uint32_t cycles;
+    uint32_t busy;          // Beats accepted
+    uint32_t starved;       // Ready without input
+    uint32_t backpressure;  // Result waiting for out_ready
+    uint32_t row_groups;    // Results output
+    uint32_t sram_reads;    // Vector SRAM reads
+} PerfCounters;
+
+#define PERF_CTRL 7
+#define PERF_ENABLE 1
+#define PERF_CLEAR 2
+
+// Write a counter register; takes effect at the next step.
+static void write_perf_counter(Vmatmul_tb *dut, int addr, uint32_t value) {
+    dut->csr_addr = addr;
+    dut->csr_wdata = value;
+    dut->csr_we = 1;
+}
+
+// Read all counters, one register per step. cycles is read first, as of the first step.
+template <typename Step>
+static PerfCounters read_perf_counters(Vmatmul_tb *dut, Step step) {
+    uint32_t values[6];
+    dut->csr_we = 0;
+    for (int addr = 0; addr < 6; addr++) {
+        dut->csr_addr = addr;
+        step();
+        values[addr] = dut->csr_rdata;
+    }
+    PerfCounters perf;
+    memcpy(&perf, values, sizeof(perf));
+    return perf;
+}
+
+/**
+ * If the testbench is quiet and the DRAM has nothing to deliver, skip the cycles up to the next
+ * DRAM event (at most max_cycles) without evaluating the DUT; the outputs of both stay as they
+ * are. Returns the number of cycles skipped, 0 if the next cycle has to be simulated. The core's
+ * counters miss the skipped cycles: add them to cycles, and to starved if in_ready.
+ */
+static uint64_t fast_forward(Vmatmul_tb *dut, Dram &dram, uint64_t max_cycles) {
+    connect(dut, dram);
+    dut->eval();
+    if (!dut->quiet) {
+        return 0;
+    }
+    uint64_t n = std::min(dram.next_event_cycle() - dram.cycle - 1, max_cycles);
+    if (n > 0) {
+        dram.fast_forward(n);
+    }
+    return n;
+}
+
+typedef struct DmaRun {
+    std::vector<uint32_t> results;
+    uint64_t cycles;       // From DMA start to the last result
+    uint64_t starved;      // Cycles the core was ready but had no matrix data
+    PerfCounters perf;     // Counted by the core from DMA start
+} DmaRun;
+
+/**
+ * Matrix-vector multiplication with the matrix streamed from DRAM by the DMA.
+ * max_outstanding and fifo_beats limit the prefetching of the DMA.
+ */
+DmaRun hw_matmul_dma(const std::vector<std::vector<uint8_t>>& matrix, const std::vector<uint8_t>& vector,
+                     int max_outstanding, int fifo_beats, const DramTiming &timing) {
+    Vmatmul_tb* dut = new Vmatmul_tb;
+    Dram dram(1 << 24, timing);
+
+    uint16_t vdim = matrix.size();
+    uint16_t hdim = vector.size();
+
+    // Matrix is stored row-major in DRAM, rows padded to whole beats.
+    const size_t base = 0x10000;
+    std::vector<uint8_t> packed = pack_matrix(matrix, hdim);
+    dram.data.write(base, packed.data(), packed.size());
+
+    dut->rst = 1;
+    dram.in.rst = 1;
+    clock_cycle(dut, dram);
+    dut->rst = 0;
+    dram.in.rst = 0;
+
+    dut->in_valid = 0;
+    dut->out_ready = 1;
+    std::vector<uint8_t> words = pack_vector(vector);
+    for (int i = 0; i < row_beats(hdim); i++) {
+        dut->vec_sram_we = 1;
+        dut->vec_sram_addr = i;
+        set_port(dut->vec_sram_din, &words[i * WORD_BYTES], WORD_BYTES);
+        clock_cycle(dut, dram);
+    }
+    dut->vec_sram_we = 0;
+    // Switch the core to the bank just written.
+    dut->vec_swap = 1;
+    clock_cycle(dut, dram);
+    dut->vec_swap = 0;
+
+    dut->vdim = vdim;
+    dut->hdim = hdim;
+    dut->use_dma = 1;
+    dut->dma_max_outstanding = max_outstanding;
+    dut->dma_fifo_beats = fifo_beats;
+    dut->dma_base = base;
+    dut->dma_length = packed.size();
+    dut->dma_start = 1;
+    write_perf_counter(dut, PERF_CTRL, PERF_CLEAR | PERF_ENABLE);
+    clock_cycle(dut, dram);
+    dut->dma_start = 0;
+    dut->csr_we = 0;
+
+    DmaRun run;
+    run.cycles = 1;
+    run.starved = 0;
+    while (run.results.size() < vdim) {
+        clock_cycle(dut, dram);
+        run.cycles++;
+        if (dut->in_ready && !dut->dma_valid) {
+            run.starved++;
+        }
+        if (dut->out_valid) {
+            get_results(dut->out_data, run.results);
+        }
+        assert(run.cycles < 1000000);
+    }
+    run.results.resize(vdim); // Drop the padding rows
+    run.perf = read_perf_counters(dut, [&]() { clock_cycle(dut, dram); });
+
+    delete dut;
+    return run;
+}
+
+/**
+ * Run a sequence of matrix-vector multiplications ("layers"), with matrices and vectors in DRAM.
+ * All matrices have the same number of rows, the number of columns may differ.
+ * The vector of each layer is loaded by the vector DMA into the fill bank. With overlap, it is
+ * loaded while the previous layer computes; otherwise only after it has finished.
+ * Returns the results of all layers, concatenated.
+ */
+DmaRun hw_matmul_layers(const std::vector<std::vector<std::vector<uint8_t>>>& matrices,
+                        const std::vector<std::vector<uint8_t>>& vectors, bool overlap) {
+    Vmatmul_tb* dut = new Vmatmul_tb;
+    Dram dram(1ull << 30, DramTiming());
+
+    size_t vdim = matrices[0].size();
+    size_t layers = matrices.size();
+
+    // Matrices, then vectors, each starting on a 4 KB boundary.
+    std::vector<size_t> matrix_addr(layers), matrix_bytes(layers), vector_addr(layers), vector_bytes(layers);
+    size_t addr = 0x100000;
+    for (size_t l = 0; l < layers; l++) {
+        assert(matrices[l].size() == vdim);
+        std::vector<uint8_t> packed = pack_matrix(matrices[l], vectors[l].size());
+        dram.data.write(addr, packed.data(), packed.size());
+        matrix_addr[l] = addr;
+        matrix_bytes[l] = packed.size();
+        addr += (packed.size() + 4095) & ~(size_t)4095;
+    }
+    for (size_t l = 0; l < layers; l++) {
+        std::vector<uint8_t> words = pack_vector(vectors[l]);
+        assert(words.size() <= SRAM_DEPTH * WORD_BYTES);
+        dram.data.write(addr, words.data(), words.size());
+        vector_addr[l] = addr;
+        vector_bytes[l] = words.size();
+        addr += (words.size() + 4095) & ~(size_t)4095;
+    }
+    assert(addr <= dram.size);
+
+    dut->rst = 1;
+    dram.in.rst = 1;
+    clock_cycle(dut, dram);
+    dut->rst = 0;
+    dram.in.rst = 0;
+
+    dut->in_valid = 0;
+    dut->out_ready = 1;
+    dut->vdim = vdim;
+    dut->use_dma = 1;
+    dut->dma_max_outstanding = 8;
+    dut->dma_fifo_beats = 64;
+
+    DmaRun run;
+    run.cycles = 0;
+    run.starved = 0;
+    auto step = [&]() {
+        // A skipped stretch counts as that many cycles in the same state.
+        uint64_t n = fast_forward(dut, dram, UINT64_MAX);
+        if (n == 0) {
+            clock_cycle(dut, dram);
+            n = 1;
+        }
+        run.cycles += n;
+        if (dut->in_ready && !dut->dma_valid) {
+            run.starved += n;
+        }
+        if (dut->out_valid) {
+            get_results(dut->out_data, run.results);
+        }
+        assert(run.cycles < 100000000);
+    };
+    auto load_vector = [&](size_t l) {
+        dut->vec_dma_base = vector_addr[l];
+        dut->vec_dma_length = vector_bytes[l];
+        dut->vec_dma_start = 1;
+    };
+    auto wait_vector = [&]() {
+        while (dut->vec_dma_busy) {
+            step();
+        }
+        dut->vec_swap = 1;
+        step();
+        dut->vec_swap = 0;
+    };
+
+    load_vector(0);
+    step();
+    dut->vec_dma_start = 0;
+    wait_vector();
+
+    for (size_t l = 0; l < layers; l++) {
+        bool prefetch = overlap && l + 1 < layers;
+        dut->hdim = vectors[l].size();
+        dut->start = 1;
+        dut->dma_base = matrix_addr[l];
+        dut->dma_length = matrix_bytes[l];
+        dut->dma_start = 1;
+        if (prefetch) {
+            load_vector(l + 1);
+        }
+        step();
+        dut->start = 0;
+        dut->dma_start = 0;
+        dut->vec_dma_start = 0;
+
+        // Results come ROWS at a time, the last group may include padding rows.
+        size_t expected = l * vdim + (vdim + ROWS - 1) / ROWS * ROWS;
+        while (run.results.size() < expected) {
+            step();
+        }
+        run.results.resize((l + 1) * vdim);
+
+        if (l + 1 < layers) {
+            if (!prefetch) {
+                load_vector(l + 1);
+                step();
+                dut->vec_dma_start = 0;
+            }
+            wait_vector();
+        }
+    }
+
+    delete dut;
+    return run;
+}
+
+/**
+ * Matrix-vector multiplication with rows longer than the vector SRAM. The columns are split in
+ * tiles of at most tile_cols elements, which run as consecutive layers; the partial sums of each
+ * row are added by the host.
+ */
+DmaRun hw_matmul_tiled(const std::vector<std::vector<uint8_t>>& matrix, const std::vector<uint8_t>& vector,
+                       size_t tile_cols) {
+    assert(tile_cols % LANES == 0 && tile_cols <= SRAM_DEPTH * LANES);
+    size_t vdim = matrix.size();
+    size_t hdim = vector.size();
+    std::vector<std::vector<std::vector<uint8_t>>> tiles;
+    std::vector<std::vector<uint8_t>> tile_vectors;
+    for (size_t col = 0; col < hdim; col += tile_cols) {
+        size_t n = hdim - col < tile_cols ? hdim - col : tile_cols;
+        std::vector<std::vector<uint8_t>> tile(vdim);
+        for (size_t row = 0; row < vdim; row++) {
+            tile[row].assign(matrix[row].begin() + col, matrix[row].begin() + col + n);
+        }
+        tiles.push_back(std::move(tile));
+        tile_vectors.emplace_back(vector.begin() + col, vector.begin() + col + n);
+    }
+
+    DmaRun run = hw_matmul_layers(tiles, tile_vectors, true);
+    std::vector<uint32_t> sums(vdim, 0);
+    for (size_t i = 0; i < run.results.size(); i++) {
+        sums[i % vdim] += run.results[i];
+    }
+    run.results = sums;
+    return run;
+}
+
+// Requantization of the results to int8 (see rtl/requant.v). Must match its ACT_FRAC_BITS parameter.
+#define ACT_FRAC_BITS 4
+enum Activation { ACT_NONE = 0, ACT_RELU = 1, ACT_SILU = 2 };
+
+typedef struct Requant {
+    uint32_t offset;                    // Subtracted from each result
+    uint16_t scale;                     // For all rows, if there are no row scales
+    std::vector<uint16_t> row_scales;   // Scale of each row
+    int shift;
+    Activation act;
+} Requant;
+
+/**
+ * Stream a packed matrix of vdim rows from DRAM, and multiply it with up to BATCH vectors.
+ * Returns the results for each vector. With rq, the results are requantized instead, and their
+ * output beats are appended to rq_bytes.
+ */
+static std::vector<std::vector<uint32_t>> hw_matmul_stream(const std::vector<uint8_t>& packed, size_t vdim,
+                                                           const std::vector<std::vector<uint8_t>>& vectors,
+                                                           uint64_t *cycles, const Requant *rq = nullptr,
+                                                           std::vector<uint8_t> *rq_bytes = nullptr) {
+    Vmatmul_tb* dut = new Vmatmul_tb;
+    Dram dram(1 << 26, DramTiming());
+
+    uint16_t hdim = vectors[0].size();
+
+    const size_t base = 0x10000;
+    dram.data.write(base, packed.data(), packed.size());
+
+    dut->rst = 1;
+    dram.in.rst = 1;
+    clock_cycle(dut, dram);
+    dut->rst = 0;
+    dram.in.rst = 0;
+
+    dut->in_valid = 0;
+    dut->out_ready = 1;
+    std::vector<uint8_t> words = pack_vectors(vectors);
+    for (int i = 0; i < row_beats(hdim); i++) {
+        dut->vec_sram_we = 1;
+        dut->vec_sram_addr = i;
+        set_port(dut->vec_sram_din, &words[i * WORD_BYTES], WORD_BYTES);
+        clock_cycle(dut, dram);
+    }
+    dut->vec_sram_we = 0;
+    dut->vec_swap = 1;
+    clock_cycle(dut, dram);
+    dut->vec_swap = 0;
+
+    if (rq) {
+        dut->rq_enable = 1;
+        dut->rq_ready = 1;
+        dut->rq_offset = rq->offset;
+        dut->rq_scale = rq->scale;
+        dut->rq_shift = rq->shift;
+        dut->rq_act = rq->act;
+        dut->rq_per_row = !rq->row_scales.empty();
+        // One word per group of rows, padding rows get scale 0.
+        for (size_t group = 0; group * ROWS < rq->row_scales.size(); group++) {
+            uint8_t word[ROWS * 2] = {0};
+            for (size_t r = 0; r < ROWS && group * ROWS + r < rq->row_scales.size(); r++) {
+                memcpy(&word[2 * r], &rq->row_scales[group * ROWS + r], 2);
+            }
+            dut->rq_scale_we = 1;
+            dut->rq_scale_addr = group;
+            set_port(dut->rq_scale_din, word, sizeof(word));
+            clock_cycle(dut, dram);
+        }
+        dut->rq_scale_we = 0;
+    }
+
+    dut->vdim = vdim;
+    dut->hdim = hdim;
+    dut->use_dma = 1;
+    dut->dma_max_outstanding = 8;
+    dut->dma_fifo_beats = 64;
+    dut->dma_base = base;
+    dut->dma_length = packed.size();
+    dut->dma_start = 1;
+    clock_cycle(dut, dram);
+    dut->dma_start = 0;
+
+    std::vector<std::vector<uint32_t>> results(BATCH);
+    *cycles = 1;
+    bool done = false;
+    while (!done) {
+        clock_cycle(dut, dram);
+        (*cycles)++;
+        if (dut->out_valid) {
+            get_results(dut->out_data, results);
+        }
+        if (rq && dut->rq_valid) {
+            std::vector<uint32_t> words;
+            get_port(dut->rq_data, words);
+            size_t size = rq_bytes->size();
+            rq_bytes->resize(size + 4 * words.size());
+            memcpy(&(*rq_bytes)[size], words.data(), 4 * words.size());
+        }
+        done = rq ? dut->rq_valid && dut->rq_last : results[0].size() >= vdim;
+        assert(*cycles < 1000000);
+    }
+    for (auto &r : results) {
+        r.resize(vdim); // Drop the padding rows
+    }
+
+    delete dut;
+    return results;
+}
+
+/**
+ * Multiply the matrix with BATCH vectors at once, streaming the matrix from DRAM only once.
+ * Returns the results for each vector.
+ */
+std::vector<std::vector<uint32_t>> hw_matmul_batch(const std::vector<std::vector<uint8_t>>& matrix,
+                                                   const std::vector<std::vector<uint8_t>>& vectors,
+                                                   uint64_t *cycles) {
+    return hw_matmul_stream(pack_matrix(matrix, vectors[0].size()), matrix.size(), vectors, cycles);
+}
+
+// Elements per beat of the transposed core, which takes the whole matrix beat as 8-bit elements.
+#define T_LANES (ROWS * LANES * WEIGHT_BITS / 8)
+
+/**
+ * Vector-matrix products p^T M with the transposed core, one per matrix, all on the same core.
+ * Each matrix is streamed from DRAM row by row, rows padded to whole beats of T_LANES elements.
+ * The output is read with backpressure, to test that it is held.
+ */
+std::vector<std::vector<uint32_t>> hw_matmul_t(const std::vector<std::vector<std::vector<uint8_t>>>& matrices,
+                                               const std::vector<std::vector<uint8_t>>& vectors) {
+    Vmatmul_tb* dut = new Vmatmul_tb;
+    Dram dram(1 << 26, DramTiming());
+
+    dut->rst = 1;
+    dram.in.rst = 1;
+    clock_cycle(dut, dram);
+    dut->rst = 0;
+    dram.in.rst = 0;
+
+    dut->in_valid = 0;
+    dut->transpose = 1;
+    dut->use_dma = 1;
+    dut->dma_max_outstanding = 8;
+    dut->dma_fifo_beats = 64;
+
+    std::vector<std::vector<uint32_t>> results;
+    uint64_t cycles = 0;
+    for (size_t m = 0; m < matrices.size(); m++) {
+        const auto &matrix = matrices[m];
+        size_t vdim = matrix.size();
+        size_t hdim = matrix[0].size();
+        assert(vectors[m].size() == vdim && vdim <= SRAM_DEPTH * VEC_LANES);
+
+        // Rows in whole beats.
+        size_t beats = (hdim + T_LANES - 1) / T_LANES;
+        std::vector<uint8_t> packed(vdim * beats * T_LANES, 0);
+        for (size_t row = 0; row < vdim; row++) {
+            memcpy(&packed[row * beats * T_LANES], matrix[row].data(), hdim);
+        }
+        const size_t base = 0x10000;
+        dram.data.write(base, packed.data(), packed.size());
+
+        std::vector<uint8_t> words = pack_vector(vectors[m]);
+        for (int i = 0; i < row_beats(vdim); i++) {
+            dut->vec_sram_we = 1;
+            dut->vec_sram_addr = i;
+            set_port(dut->vec_sram_din, &words[i * WORD_BYTES], WORD_BYTES);
+            clock_cycle(dut, dram);
+        }
+        dut->vec_sram_we = 0;
+        dut->vec_swap = 1;
+        clock_cycle(dut, dram);
+        dut->vec_swap = 0;
+
+        dut->vdim = vdim;
+        dut->hdim = hdim;
+        dut->start = m > 0;
+        dut->dma_base = base;
+        dut->dma_length = packed.size();
+        dut->dma_start = 1;
+        clock_cycle(dut, dram);
+        dut->start = 0;
+        dut->dma_start = 0;
+
+        std::vector<uint32_t> result;
+        bool done = false;
+        while (!done) {
+            dut->t_out_ready = cycles % 3 != 0;
+            dut->eval();
+            done = dut->t_out_valid && dut->t_out_ready && dut->t_out_last;
+            if (dut->t_out_valid && dut->t_out_ready) {
+                get_port(dut->t_out_data, result);
+            }
+            clock_cycle(dut, dram);
+            cycles++;
+            assert(cycles < 10000000);
+        }
+        result.resize(hdim); // Drop the padding lanes
+        results.push_back(result);
+    }
+
+    delete dut;
+    return results;
+}
+
+// Software implementation of the vector-matrix product p^T M.
+static std::vector<uint32_t> sw_matmul_t(const std::vector<std::vector<uint8_t>>& matrix,
+                                         const std::vector<uint8_t>& vector) {
+    std::vector<uint32_t> result(matrix[0].size());
+    gemv_t(Matrix8(matrix), vector.data(), result.data());
+    return result;
+}
+
+// Software reference for the requantization of one result.
+static int8_t sw_requant(uint32_t x, uint16_t scale, const Requant &rq) {
+    int64_t y = ((int64_t)x - rq.offset) * scale;
+    if (rq.shift > 0) {
+        y = (y + ((int64_t)1 << (rq.shift - 1))) >> rq.shift;
+    }
+    y = std::clamp<int64_t>(y, -32768, 32767);
+    if (rq.act == ACT_RELU) {
+        y = std::max<int64_t>(y, 0);
+    } else if (rq.act == ACT_SILU) {
+        const int64_t one = 1 << ACT_FRAC_BITS;
+        int64_t sigmoid = std::clamp<int64_t>((y >> 2) + one / 2, 0, one);
+        y = (y * sigmoid) >> ACT_FRAC_BITS;
+    }
+    return (int8_t)std::clamp<int64_t>(y, -128, 127);
+}
+
+// Requantized results in the output order of the core: row by row, the vectors of the batch within a row.
+static std::vector<uint8_t> sw_requant(const std::vector<std::vector<uint32_t>>& results, const Requant &rq) {
+    std::vector<uint8_t> bytes;
+    for (size_t row = 0; row < results[0].size(); row++) {
+        uint16_t scale = rq.row_scales.empty() ? rq.scale : rq.row_scales[row];
+        for (size_t b = 0; b < results.size(); b++) {
+            bytes.push_back((uint8_t)sw_requant(results[b][row], scale, rq));
+        }
+    }
+    return bytes;
+}
+
+// The core's configuration, as the runtime and the weight image writer take it.
+static CoreConfig core_config() {
+    CoreConfig config;
+    config.lanes = LANES;
+    config.rows = ROWS;
+    config.batch = BATCH;
+    config.sram_depth = SRAM_DEPTH;
+    return config;
+}
+
+// Software reference for 4-bit weights, with the same per-group rounding as the hardware.
+std::vector<uint32_t> sw_matmul_q4(const QuantTensor& matrix, const std::vector<uint8_t>& vector) {
+    assert(matrix.bits == 4 && matrix.cols == vector.size());
+    Matrix4 m(matrix.rows, matrix.cols, LANES);
+    for (size_t row = 0; row < m.rows; row++) {
+        for (size_t col = 0; col < m.cols; col++) {
+            m.set(row, col, matrix.q[row * m.cols + col]);
+        }
+        for (size_t g = 0; g < m.groups; g++) {
+            m.scale(row, g) = matrix.group_scales[row * m.groups + g];
+        }
+    }
+    std::vector<uint32_t> result(m.rows);
+    gemv_q4(m, vector.data(), result.data(), SCALE_SHIFT);
+    return result;
+}
+
+// Random 4-bit matrices against random vectors; returns false on a mismatch.
+static bool q4_tests() {
+    std::cout << "4-bit group quantized weights:" << std::endl;
+    srand(42);
+    const size_t shapes[][2] = {{3, 4}, {64, 200}, {256, 4096}};
+    std::cout << "Rows\tCols\tBytes\tCycles\tMatch" << std::endl;
+    bool all_match = true;
+    for (const auto &shape : shapes) {
+        QuantTensor matrix;
+        matrix.bits = 4;
+        matrix.rows = shape[0];
+        matrix.cols = shape[1];
+        matrix.q.resize(shape[0] * shape[1]);
+        matrix.group_scales.resize(shape[0] * row_beats(shape[1]));
+        for (auto &v : matrix.q) v = rand() & 0xF;
+        for (auto &v : matrix.group_scales) v = rand() & 0xFFFF;
+        std::vector<uint8_t> vector(shape[1]);
+        for (auto &v : vector) v = rand() & 0xFF;
+
+        std::vector<uint8_t> packed = pack_q4_tile(core_config(), matrix, 0, shape[0], 0, shape[1]);
+        uint64_t cycles;
+        std::vector<std::vector<uint32_t>> results = hw_matmul_stream(packed, shape[0], {vector}, &cycles);
+        bool match = results[0] == sw_matmul_q4(matrix, vector);
+        std::cout << shape[0] << "\t" << shape[1] << "\t" << packed.size() << "\t" << cycles << "\t"
+                  << (match ? "Yes" : "No") << std::endl;
+        if (!match) all_match = false;
+    }
+    return all_match;
+}
+
 // Function to perform matrix-vector multiplication using the matmul hardware
 std::vector<uint32_t> hw_matmul(const std::vector<std::vector<uint8_t>>& matrix, const std::vector<uint8_t>& vector) {
     // Create and initialize the hardware module
@@ -15,8 +787,8 @@ std::vector<uint32_t> hw_matmul(const std::vector<std::vector<uint8_t>>& matrix,
     dut->clk = 0; dut->rst = 0; dut->eval();
     
     // Prepare dimensions
-    uint8_t vdim = matrix.size();    // Number of rows
-    uint8_t hdim = vector.size();    // Number of columns
+    uint16_t vdim = matrix.size();   // Number of rows
+    uint16_t hdim = vector.size();   // Number of columns
     
     // Set up for input
     dut->in_valid = 0;
@@ -24,62 +796,58 @@ std::vector<uint32_t> hw_matmul(const std::vector<std::vector<uint8_t>>& matrix,
     dut->vec_sram_we = 0;
     dut->eval();
     
-    // Preload vector data into the SRAM
-    for (int i = 0; i < hdim; i++) {
+    // Preload vector data into the SRAM, LANES elements per word (as the first vector of the batch)
+    std::vector<uint8_t> words = pack_vector(vector);
+    for (int i = 0; i < row_beats(hdim); i++) {
         dut->vec_sram_we = 1;
         dut->vec_sram_addr = i;
-        dut->vec_sram_din = vector[i];
+        set_port(dut->vec_sram_din, &words[i * WORD_BYTES], WORD_BYTES);
         dut->clk = 1; dut->eval();
         dut->clk = 0; dut->eval();
     }
     dut->vec_sram_we = 0;
+    // The vector was written to the fill bank, switch the core to it.
+    dut->vec_swap = 1;
+    dut->clk = 1; dut->eval();
+    dut->clk = 0; dut->vec_swap = 0; dut->eval();
     printf("Vector loaded into SRAM.\n");
     
     // Set dimensions directly in the registers
     dut->vdim = vdim;
     dut->hdim = hdim;
+    printf("Matrix dimensions set: %d x %d, %d lanes, %d rows, batch %d\n", vdim, hdim, LANES, ROWS, BATCH);
     
-    // Continue with READ_MATRIX state
-    printf("Matrix dimensions set: %d x %d\n", vdim, hdim);
-    dut->in_valid = 1;
-    
-    // Send matrix rows and collect results
+    // Send matrix beats and collect results
+    const size_t beat_bytes = ROWS * LANES;
+    std::vector<uint8_t> beats = pack_matrix(matrix, hdim);
+    size_t num_beats = beats.size() / beat_bytes;
+    size_t sent = 0;
     std::vector<uint32_t> results;
     results.reserve(vdim);
     
     printf("Starting matrix-vector multiplication...\n");
-    for (int row = 0; row < vdim; row++) {
-        // Send each element in the row
-        for (int col = 0; col < hdim; col++) {
-            printf("Sending row %d, col %d: %u\n", row, col, matrix[row][col]);
-            dut->in_data = matrix[row][col];
-            dut->clk = 1; dut->eval();
-            
-            // Check if result is ready
-            if (dut->out_valid) {
-                uint32_t d = dut->out_data;
-                results.push_back(d);
-                printf("Row %d, Col %d: %u\n", row, col, d);
-            }
-            
-            dut->clk = 0; dut->eval();
-        }
-    }
-    printf("Matrix-vector multiplication completed.\n");
-    
-    // Make sure we've received all results
     while (results.size() < vdim) {
-        // printf("Waiting for result %d of %d...\n", results.size(), vdim);
-        dut->in_valid = 0;
+        dut->in_valid = sent < num_beats;
+        if (sent < num_beats) {
+            set_port(dut->in_data, &beats[sent * beat_bytes], beat_bytes);
+        }
+        dut->eval();
+        bool fire = dut->in_valid && dut->in_ready;
+
         dut->clk = 1; dut->eval();
-        
+        if (fire) {
+            sent++;
+        }
         if (dut->out_valid) {
-            printf("Received result: %u\n", dut->out_data);
-            results.push_back(dut->out_data);
+            size_t first = results.size();
+            get_results(dut->out_data, results);
+            for (size_t i = first; i < results.size(); i++) {
+                LOG("Received result: %u\n", results[i]);
+            }
         }
-        
         dut->clk = 0; dut->eval();
     }
+    results.resize(vdim); // Drop the padding rows
     printf("All results received.\n");
     
     // Clean up
@@ -87,23 +855,955 @@ std::vector<uint32_t> hw_matmul(const std::vector<std::vector<uint8_t>>& matrix,
     return results;
 }
 
-// Software implementation of matrix-vector multiplication
+// Software implementation of matrix-vector multiplication (see reference.h)
 std::vector<uint32_t> sw_matmul(const std::vector<std::vector<uint8_t>>& matrix, const std::vector<uint8_t>& vector) {
+    std::vector<uint32_t> result(matrix.size());
+    gemv(Matrix8(matrix), vector.data(), result.data());
+    return result;
+}
+
+/**
+ * 2:4 sparse matrix (at most 2 non-zeros in every aligned group of 4 columns) in the layout the core
+ * expects: beats of LANES values, 2 per group of 4 columns, with an index beat before every run of
+ * 4 value beats of a group of rows. Groups with fewer non-zeros are padded with zero values.
+ */
+static std::vector<uint8_t> pack_sparse_matrix(const std::vector<std::vector<uint8_t>>& matrix, size_t hdim) {
+    const size_t beat_bytes = ROWS * LANES;
+    size_t beats = row_beats(hdim);
+    size_t vdim = matrix.size();
+    std::vector<uint8_t> packed;
+    for (size_t group = 0; group * ROWS < vdim; group++) {
+        for (size_t run = 0; run < beats; run += 4) {
+            size_t run_beats = beats - run < 4 ? beats - run : 4;
+            std::vector<uint8_t> index_beat(beat_bytes, 0);
+            std::vector<uint8_t> value_beats(run_beats * beat_bytes, 0);
+            for (size_t r = 0; r < ROWS && group * ROWS + r < vdim; r++) {
+                const std::vector<uint8_t> &row = matrix[group * ROWS + r];
+                for (size_t k = 0; k < run_beats; k++) {
+                    for (size_t i = 0; i < LANES; i += 2) {
+                        // Values i and i + 1 hold the non-zeros of columns [col, col + 4).
+                        size_t col = (run + k) * VEC_LANES + i * 2;
+                        uint8_t index[2] = {0, 1};
+                        uint8_t value[2] = {0, 0};
+                        int n = 0;
+                        for (size_t c = 0; c < 4 && col + c < hdim; c++) {
+                            if (row[col + c]) {
+                                assert(n < 2);
+                                index[n] = c;
+                                value[n] = row[col + c];
+                                n++;
+                            }
+                        }
+                        for (size_t j = 0; j < 2; j++) {
+                            size_t lane = k * LANES + i + j; // Within the run
+                            value_beats[k * beat_bytes + r * LANES + i + j] = value[j];
+                            index_beat[r * LANES + lane / 4] |= index[j] << (2 * (lane % 4));
+                        }
+                    }
+                }
+            }
+            packed.insert(packed.end(), index_beat.begin(), index_beat.end());
+            packed.insert(packed.end(), value_beats.begin(), value_beats.end());
+        }
+    }
+    return packed;
+}
+
+// Random 2:4 sparse matrices against random vectors; returns false on a mismatch.
+static bool sparse_tests() {
+    std::cout << "2:4 sparse weights:" << std::endl;
+    srand(42);
+    const size_t shapes[][2] = {{3, 4}, {64, 200}, {256, 4096}};
+    std::cout << "Rows\tCols\tBytes\tDense\tCycles\tMatch" << std::endl;
+    bool all_match = true;
+    for (const auto &shape : shapes) {
+        // Keep 2 random columns of every 4.
+        std::vector<std::vector<uint8_t>> matrix(shape[0], std::vector<uint8_t>(shape[1]));
+        for (auto &row : matrix) {
+            for (auto &v : row) v = rand() & 0xFF;
+            for (size_t col = 0; col < shape[1]; col += 4) {
+                size_t keep = rand() % 4, keep2 = (keep + 1 + rand() % 3) % 4;
+                for (size_t c = 0; c < 4 && col + c < shape[1]; c++) {
+                    if (c != keep && c != keep2) row[col + c] = 0;
+                }
+            }
+        }
+        std::vector<uint8_t> vector(shape[1]);
+        for (auto &v : vector) v = rand() & 0xFF;
+
+        std::vector<uint8_t> packed = pack_sparse_matrix(matrix, shape[1]);
+        uint64_t cycles;
+        std::vector<std::vector<uint32_t>> results = hw_matmul_stream(packed, shape[0], {vector}, &cycles);
+        bool match = results[0] == sw_matmul(matrix, vector);
+        std::cout << shape[0] << "\t" << shape[1] << "\t" << packed.size() << "\t"
+                  << pack_matrix(matrix, shape[1]).size() << "\t" << cycles << "\t"
+                  << (match ? "Yes" : "No") << std::endl;
+        if (!match) all_match = false;
+    }
+    return all_match;
+}
+
+/**
+ * One randomized case on its own model: shape, value distribution, input gaps and output
+ * backpressure all follow from the seed, so a failing seed reproduces on its own.
+ * Returns whether the results match; *cycles is the simulated cycle count.
+ */
+static bool regress_case(VerilatedContext *context, uint64_t seed, uint64_t *cycles) {
+    std::mt19937_64 rng(seed);
+    const size_t beat_bytes = ROWS * LANES * WEIGHT_BITS / 8;
+    size_t vdim = 1 + rng() % 300;
+    size_t hdim = 1 + rng() % std::min<size_t>(2048, SRAM_DEPTH * VEC_LANES);
+    int gap_pct = rng() % 60;       // Cycles without input
+    int stall_pct = rng() % 60;     // Cycles without out_ready
+    int values = rng() % 4;         // Uniform, all ones (largest sums), mostly zeros, small
+    const uint8_t max_weight = WEIGHT_BITS == 4 ? 15 : 255;
+    auto value = [&](uint8_t max) -> uint8_t {
+        switch (values) {
+            case 1: return max;
+            case 2: return rng() % 8 ? 0 : rng() % (max + 1);
+            case 3: return rng() % 4;
+            default: return rng() % (max + 1);
+        }
+    };
+
+    std::vector<std::vector<uint8_t>> matrix(vdim, std::vector<uint8_t>(hdim));
+    for (auto &row : matrix) {
+        for (auto &v : row) v = value(max_weight);
+    }
+    std::vector<std::vector<uint8_t>> vectors(BATCH, std::vector<uint8_t>(hdim));
+    for (auto &vec : vectors) {
+        for (auto &v : vec) v = value(255);
+    }
+    std::vector<std::vector<uint32_t>> expected;
+#if WEIGHT_BITS == 4
+    QuantTensor qmatrix;
+    qmatrix.bits = 4;
+    qmatrix.rows = vdim;
+    qmatrix.cols = hdim;
+    for (const auto &row : matrix) {
+        qmatrix.q.insert(qmatrix.q.end(), row.begin(), row.end());
+    }
+    qmatrix.group_scales.resize(vdim * row_beats(hdim));
+    for (auto &v : qmatrix.group_scales) v = values == 1 ? 0xFFFF : rng();
+    std::vector<uint8_t> packed = pack_q4_tile(core_config(), qmatrix, 0, vdim, 0, hdim);
+    for (const auto &vec : vectors) expected.push_back(sw_matmul_q4(qmatrix, vec));
+#elif SPARSE
+    for (auto &row : matrix) {
+        for (size_t col = 0; col < hdim; col += 4) {
+            size_t keep = rng() % 4, keep2 = (keep + 1 + rng() % 3) % 4;
+            for (size_t c = 0; c < 4 && col + c < hdim; c++) {
+                if (c != keep && c != keep2) row[col + c] = 0;
+            }
+        }
+    }
+    std::vector<uint8_t> packed = pack_sparse_matrix(matrix, hdim);
+    for (const auto &vec : vectors) expected.push_back(sw_matmul(matrix, vec));
+#else
+    std::vector<uint8_t> packed = pack_matrix(matrix, hdim);
+    for (const auto &vec : vectors) expected.push_back(sw_matmul(matrix, vec));
+#endif
+
+    std::unique_ptr<Vmatmul_tb> dut(new Vmatmul_tb(context));
+    auto step = [&]() {
+        dut->clk = 1; dut->eval();
+        dut->clk = 0; dut->eval();
+        (*cycles)++;
+    };
+    *cycles = 0;
+    dut->rst = 1;
+    step();
+    dut->rst = 0;
+
+    std::vector<uint8_t> words = pack_vectors(vectors);
+    for (int i = 0; i < row_beats(hdim); i++) {
+        dut->vec_sram_we = 1;
+        dut->vec_sram_addr = i;
+        set_port(dut->vec_sram_din, &words[i * WORD_BYTES], WORD_BYTES);
+        step();
+    }
+    dut->vec_sram_we = 0;
+    dut->vec_swap = 1;
+    step();
+    dut->vec_swap = 0;
+    dut->vdim = vdim;
+    dut->hdim = hdim;
+
+    // A beat stays valid until it is accepted; gaps only come between beats.
+    size_t num_beats = packed.size() / beat_bytes;
+    size_t sent = 0;
+    size_t rows = (vdim + ROWS - 1) / ROWS * ROWS;
+    std::vector<std::vector<uint32_t>> results(BATCH);
+    const uint64_t limit = 100 + 4 * (num_beats + rows) * 100 / (100 - std::max(gap_pct, stall_pct));
+    while (results[0].size() < rows && *cycles < limit) {
+        if (!dut->in_valid) {
+            dut->in_valid = sent < num_beats && (int)(rng() % 100) >= gap_pct;
+            if (dut->in_valid) {
+                set_port(dut->in_data, &packed[sent * beat_bytes], beat_bytes);
+            }
+        }
+        dut->out_ready = (int)(rng() % 100) >= stall_pct;
+        dut->eval();
+        bool fire = dut->in_valid && dut->in_ready;
+        if (dut->out_valid && dut->out_ready) {
+            get_results(dut->out_data, results);
+        }
+        step();
+        if (fire) {
+            sent++;
+            dut->in_valid = 0;
+        }
+    }
+    // No results beyond the last row.
+    bool extra = false;
+    dut->out_ready = 1;
+    for (int i = 0; i < 32; i++) {
+        dut->eval();
+        extra = extra || dut->out_valid;
+        step();
+    }
+
+    bool match = !extra && sent == num_beats;
+    for (int b = 0; b < BATCH; b++) {
+        results[b].resize(vdim);
+        match = match && results[b] == expected[b];
+    }
+    return match;
+}
+
+/**
+ * Run cases seeds [first_seed, first_seed + cases) on all threads, each thread with its own context
+ * and models. Prints the throughput and the failing seeds; returns whether all passed.
+ */
+static bool regress(size_t cases, uint64_t first_seed, unsigned threads) {
+    std::atomic<size_t> next{0};
+    std::atomic<uint64_t> total_cycles{0};
+    std::mutex mutex;
+    std::vector<uint64_t> failed;
+    auto start = std::chrono::steady_clock::now();
+    auto worker = [&]() {
+        VerilatedContext context;
+        for (size_t i = next++; i < cases; i = next++) {
+            uint64_t seed = first_seed + i;
+            uint64_t cycles;
+            bool pass = regress_case(&context, seed, &cycles);
+            total_cycles += cycles;
+            if (!pass) {
+                std::lock_guard<std::mutex> lock(mutex);
+                failed.push_back(seed);
+            }
+        }
+    };
+    std::vector<std::thread> pool;
+    for (unsigned t = 0; t < threads; t++) {
+        pool.emplace_back(worker);
+    }
+    for (std::thread &t : pool) {
+        t.join();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::sort(failed.begin(), failed.end());
+    printf("Regression: %zu cases on %u threads in %.1f s, %.1f cases/s, %.2f Mcycles/s\n", cases, threads,
+           seconds, cases / seconds, total_cycles / seconds * 1e-6);
+    printf("%zu failed\n", failed.size());
+    for (uint64_t seed : failed) {
+        printf("  seed %llu (reproduce with: regress 1 %llu 1)\n", (unsigned long long)seed,
+               (unsigned long long)seed);
+    }
+    return failed.empty();
+}
+
+/**
+ * Benchmark: the matrix-vector products of one decoded token of LLaMA-style models. Each layer
+ * runs once, streamed either by the DMA from the Dram model or from an ideal source that offers a
+ * beat every cycle. Timing does not depend on the values, so the matrix is the DRAM fill pattern
+ * (or a constant beat), the vector is not loaded, and the results are not checked.
+ * Q, K and V are fused into one matrix, as are the FFN gate and up projections.
+ */
+typedef struct BenchLayer {
+    const char *model;
+    const char *name;
+    size_t rows;
+    size_t cols;
+    int per_token;          // Runs per token: once per block, or once for the head
+} BenchLayer;
+
+static const BenchLayer bench_layers[] = {
+    // 7B: hidden 4096, FFN 11008, 32 blocks, 32000 tokens.
+    {"7B", "qkv", 3 * 4096, 4096, 32},
+    {"7B", "o", 4096, 4096, 32},
+    {"7B", "ffn_up", 2 * 11008, 4096, 32},
+    {"7B", "ffn_down", 4096, 11008, 32},
+    {"7B", "lm_head", 32000, 4096, 1},
+    // 13B: hidden 5120, FFN 13824, 40 blocks, 32000 tokens.
+    {"13B", "qkv", 3 * 5120, 5120, 40},
+    {"13B", "o", 5120, 5120, 40},
+    {"13B", "ffn_up", 2 * 13824, 5120, 40},
+    {"13B", "ffn_down", 5120, 13824, 40},
+    {"13B", "lm_head", 32000, 5120, 1},
+};
+
+// Every cycle up to the last accepted beat is busy, starved or backpressure; the rest is drain.
+typedef struct BenchRun {
+    uint64_t cycles;        // From the start to the last result
+    uint64_t busy;          // A beat was accepted
+    uint64_t starved;       // Core ready, no beat available
+    uint64_t backpressure;  // Beat available, core not ready
+    uint64_t drain;         // After the last beat
+    uint64_t skipped;       // Fast-forwarded while waiting on DRAM
+} BenchRun;
+
+static BenchRun bench_layer(VerilatedContext *context, const BenchLayer &layer, bool use_dram) {
+    const size_t beat_bytes = ROWS * LANES;
+    const size_t groups = (layer.rows + ROWS - 1) / ROWS;
+    const size_t num_beats = groups * row_beats(layer.cols);
+    const size_t base = 0x10000;
+    std::unique_ptr<Vmatmul_tb> dut(new Vmatmul_tb(context));
+    // Pages are only allocated on write, so the unwritten matrix costs no memory.
+    std::unique_ptr<Dram> dram(use_dram ? new Dram(base + num_beats * beat_bytes, DramTiming()) : nullptr);
+    auto step = [&]() {
+        if (dram) {
+            clock_cycle(dut.get(), *dram);
+        } else {
+            dut->clk = 1; dut->eval();
+            dut->clk = 0; dut->eval();
+        }
+    };
+
+    dut->rst = 1;
+    if (dram) dram->in.rst = 1;
+    step();
+    dut->rst = 0;
+    if (dram) dram->in.rst = 0;
+
+    dut->out_ready = 1;
+    dut->vdim = layer.rows;
+    dut->hdim = layer.cols;
+    if (dram) {
+        dut->use_dma = 1;
+        dut->dma_max_outstanding = 8;
+        dut->dma_fifo_beats = 64;
+        dut->dma_base = base;
+        dut->dma_length = num_beats * beat_bytes;
+        dut->dma_start = 1;
+    } else {
+        std::vector<uint8_t> beat(beat_bytes, 0xAB);
+        set_port(dut->in_data, beat.data(), beat_bytes);
+    }
+
+    BenchRun run = {};
+    uint64_t skipped_starved = 0;
+    size_t sent = 0, outputs = 0;
+    while (outputs < groups) {
+        uint64_t skip = dram ? fast_forward(dut.get(), *dram, UINT64_MAX) : 0;
+        if (skip) {
+            // Waiting on DRAM: no input, no output.
+            if (sent == num_beats) {
+                run.drain += skip;
+            } else {
+                run.starved += skip;
+                skipped_starved += skip;
+            }
+            run.cycles += skip;
+            run.skipped += skip;
+            continue;
+        }
+        if (!dram) {
+            dut->in_valid = sent < num_beats;
+        }
+        dut->eval();
+        bool valid = dram ? dut->dma_valid : dut->in_valid;
+        if (sent == num_beats) {
+            run.drain++;
+        } else if (!dut->in_ready) {
+            run.backpressure++;
+        } else if (valid) {
+            run.busy++;
+            sent++;
+        } else {
+            run.starved++;
+        }
+        outputs += dut->out_valid && dut->out_ready;
+        step();
+        dut->dma_start = 0;
+        run.cycles++;
+        assert(run.cycles < 16 * num_beats + 100000);
+    }
+    // The core counts the same events.
+    PerfCounters perf = read_perf_counters(dut.get(), step);
+    perf.cycles += run.skipped;
+    perf.starved += skipped_starved;
+    if (perf.cycles != run.cycles || perf.busy != run.busy || perf.starved != run.starved ||
+        perf.backpressure != run.backpressure || perf.row_groups != groups) {
+        fprintf(stderr, "%s %s: performance counters do not match the harness\n", layer.model, layer.name);
+        exit(1);
+    }
+    return run;
+}
+
+/**
+ * Run the layers of the models matching filter ("all" for all) from both sources on all threads.
+ * Prints a table, and writes the same records to prefix.csv and prefix.json. Token records add up
+ * the layers of one token; they leave out attention, normalization and vector loads.
+ */
+static bool bench(const char *prefix, const char *filter, unsigned threads) {
+#if WEIGHT_BITS != 8 || SPARSE
+    fprintf(stderr, "The benchmark only supports dense 8-bit weights\n");
+    return false;
+#endif
+    std::vector<BenchLayer> layers;
+    for (const BenchLayer &layer : bench_layers) {
+        if (strcmp(filter, "all") && strcmp(filter, layer.model)) continue;
+        if (layer.cols > (size_t)SRAM_DEPTH * VEC_LANES) {
+            fprintf(stderr, "%s %s: %zu columns do not fit the vector SRAM\n", layer.model, layer.name, layer.cols);
+            return false;
+        }
+        layers.push_back(layer);
+    }
+    if (layers.empty()) {
+        fprintf(stderr, "No model %s\n", filter);
+        return false;
+    }
+
+    // Job 2 * i + d runs layer i from DRAM if d is 0, from the ideal source if 1.
+    std::vector<BenchRun> runs(2 * layers.size());
+    std::atomic<size_t> next{0};
+    auto start = std::chrono::steady_clock::now();
+    auto worker = [&]() {
+        VerilatedContext context;
+        for (size_t i = next++; i < runs.size(); i = next++) {
+            runs[i] = bench_layer(&context, layers[i / 2], i % 2 == 0);
+        }
+    };
+    std::vector<std::thread> pool;
+    for (unsigned t = 0; t < threads; t++) {
+        pool.emplace_back(worker);
+    }
+    for (std::thread &t : pool) {
+        t.join();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    const double clock_ghz = DramTiming().clock_ghz;
+    const double peak_macs = (double)LANES * ROWS * BATCH;
+    std::string csv_path = std::string(prefix) + ".csv", json_path = std::string(prefix) + ".json";
+    FILE *csv = fopen(csv_path.c_str(), "w");
+    FILE *json = fopen(json_path.c_str(), "w");
+    if (!csv || !json) {
+        fprintf(stderr, "Cannot write %s or %s\n", csv_path.c_str(), json_path.c_str());
+        exit(1);
+    }
+    fprintf(csv, "model,layer,rows,cols,per_token,source,cycles,busy,starved,backpressure,drain,"
+                 "macs_per_cycle,utilization,dram_gbps,tokens_per_s\n");
+    fprintf(json, "[");
+    printf("Core: %d lanes, %d rows, batch %d, %.2f GHz\n", LANES, ROWS, BATCH, clock_ghz);
+    printf("%-5s %-9s %-6s %12s %6s %7s %7s %7s %9s %8s\n", "Model", "Layer", "Source", "Cycles", "Util",
+           "Starved", "Backpr", "Drain", "GB/s", "Tokens/s");
+
+    size_t records = 0;
+    // rows == 0 marks a token record.
+    auto emit = [&](const BenchLayer &layer, const char *source, const BenchRun &run, double macs) {
+        double macs_per_cycle = macs / run.cycles;
+        double gbps = (double)(run.busy * ROWS * LANES) / run.cycles * clock_ghz;
+        double tokens = layer.rows ? 0.0 : BATCH * clock_ghz * 1e9 / run.cycles;
+        fprintf(csv, "%s,%s,%zu,%zu,%d,%s,%llu,%llu,%llu,%llu,%llu,%.3f,%.4f,%.2f,", layer.model, layer.name,
+                layer.rows, layer.cols, layer.per_token, source, (unsigned long long)run.cycles,
+                (unsigned long long)run.busy, (unsigned long long)run.starved,
+                (unsigned long long)run.backpressure, (unsigned long long)run.drain, macs_per_cycle,
+                macs_per_cycle / peak_macs, gbps);
+        if (layer.rows) fprintf(csv, "\n"); else fprintf(csv, "%.2f\n", tokens);
+        fprintf(json, "%s\n  {\"model\": \"%s\", \"layer\": \"%s\", \"rows\": %zu, \"cols\": %zu, \"per_token\": %d, "
+                      "\"source\": \"%s\", \"cycles\": %llu, \"busy\": %llu, \"starved\": %llu, \"backpressure\": %llu, "
+                      "\"drain\": %llu, \"macs_per_cycle\": %.3f, \"utilization\": %.4f, \"dram_gbps\": %.2f, ",
+                records++ ? "," : "", layer.model, layer.name, layer.rows, layer.cols, layer.per_token, source,
+                (unsigned long long)run.cycles, (unsigned long long)run.busy, (unsigned long long)run.starved,
+                (unsigned long long)run.backpressure, (unsigned long long)run.drain, macs_per_cycle,
+                macs_per_cycle / peak_macs, gbps);
+        if (layer.rows) fprintf(json, "\"tokens_per_s\": null}"); else fprintf(json, "\"tokens_per_s\": %.2f}", tokens);
+        printf("%-5s %-9s %-6s %12llu %5.1f%% %6.1f%% %6.1f%% %6.1f%% %9.2f", layer.model, layer.name, source,
+               (unsigned long long)run.cycles, 100.0 * macs_per_cycle / peak_macs, 100.0 * run.starved / run.cycles,
+               100.0 * run.backpressure / run.cycles, 100.0 * run.drain / run.cycles, gbps);
+        if (layer.rows) printf("\n"); else printf(" %8.2f\n", tokens);
+    };
+
+    for (int d = 0; d < 2; d++) {
+        const char *source = d == 0 ? "dram" : "ideal";
+        for (size_t i = 0; i < layers.size(); i++) {
+            emit(layers[i], source, runs[2 * i + d], (double)layers[i].rows * layers[i].cols * BATCH);
+            // After the last layer of a model, its token.
+            if (i + 1 == layers.size() || strcmp(layers[i + 1].model, layers[i].model)) {
+                BenchRun token = {};
+                double macs = 0;
+                for (size_t j = 0; j < layers.size(); j++) {
+                    if (strcmp(layers[j].model, layers[i].model)) continue;
+                    const BenchRun &run = runs[2 * j + d];
+                    const uint64_t n = layers[j].per_token;
+                    token.cycles += n * run.cycles;
+                    token.busy += n * run.busy;
+                    token.starved += n * run.starved;
+                    token.backpressure += n * run.backpressure;
+                    token.drain += n * run.drain;
+                    macs += (double)n * layers[j].rows * layers[j].cols * BATCH;
+                }
+                emit(BenchLayer{layers[i].model, "token", 0, 0, 1}, source, token, macs);
+            }
+        }
+    }
+    fprintf(json, "\n]\n");
+    fclose(csv);
+    fclose(json);
+
+    uint64_t simulated = 0, skipped = 0;
+    for (const BenchRun &run : runs) {
+        simulated += run.cycles;
+        skipped += run.skipped;
+    }
+    printf("Simulated %.1f Mcycles (%.1f%% fast-forwarded) on %u threads in %.1f s, wrote %s and %s\n",
+           simulated * 1e-6, 100.0 * skipped / simulated, threads, seconds, csv_path.c_str(), json_path.c_str());
+    return true;
+}
+
+/**
+ * One core of a tensor-parallel group, with its own DRAM: computes rows [first_row, first_row + rows)
+ * of the layer for all BATCH vectors. The vector is written into its SRAM, then its slice of the
+ * matrix is streamed from its DRAM. run() advances the core by a number of cycles.
+ */
+struct SimCore {
+    enum Phase { LOAD, SWAP, START, RUN, DONE };
+
+    std::unique_ptr<VerilatedContext> context;
+    std::unique_ptr<Vmatmul_tb> dut;
+    std::unique_ptr<Dram> dram;
+    size_t first_row = 0, rows = 0, hdim = 0;
+    size_t groups = 0, num_beats = 0;
+    std::vector<uint8_t> words;                 // Vector SRAM words
+    size_t word = 0;
+    Phase phase = LOAD;
+    std::vector<std::vector<uint32_t>> results;
+    uint64_t cycles = 0;                        // Since reset
+    uint64_t run_start = 0, run_cycles = 0;     // Matrix streaming, from DMA start to the last result
+    uint64_t skipped = 0, skipped_starved = 0;  // Fast-forwarded, missed by the core's counters
+    PerfCounters perf = {};
+
+    SimCore(const std::vector<std::vector<uint8_t>>& matrix, const std::vector<std::vector<uint8_t>>& vectors,
+            size_t first, size_t count)
+        : context(new VerilatedContext), first_row(first), rows(count), hdim(vectors[0].size()),
+          words(pack_vectors(vectors)), results(BATCH) {
+        std::vector<std::vector<uint8_t>> slice(matrix.begin() + first, matrix.begin() + first + count);
+        std::vector<uint8_t> packed = pack_matrix(slice, hdim);
+        groups = (rows + ROWS - 1) / ROWS;
+        num_beats = packed.size() / (ROWS * LANES);
+        dram.reset(new Dram(base + packed.size(), DramTiming()));
+        dram->data.write(base, packed.data(), packed.size());
+        dut.reset(new Vmatmul_tb(context.get()));
+
+        dut->rst = 1;
+        dram->in.rst = 1;
+        clock_cycle(dut.get(), *dram);
+        dut->rst = 0;
+        dram->in.rst = 0;
+        dut->out_ready = 1;
+    }
+
+    static const size_t base = 0x10000;
+
+    bool done() const {
+        return phase == DONE;
+    }
+
+    void run(uint64_t budget) {
+        while (budget > 0 && phase != DONE) {
+            uint64_t n = phase == RUN ? fast_forward(dut.get(), *dram, budget) : 0;
+            if (n > 0) {
+                skipped += n;
+                skipped_starved += dut->in_ready ? n : 0;
+            } else {
+                n = 1;
+                cycle();
+            }
+            cycles += n;
+            budget -= n;
+        }
+    }
+
+    void cycle() {
+        switch (phase) {
+            case LOAD:
+                dut->vec_sram_we = 1;
+                dut->vec_sram_addr = word;
+                set_port(dut->vec_sram_din, &words[word * WORD_BYTES], WORD_BYTES);
+                clock_cycle(dut.get(), *dram);
+                dut->vec_sram_we = 0;
+                phase = ++word == (size_t)row_beats(hdim) ? SWAP : LOAD;
+                break;
+            case SWAP:
+                dut->vec_swap = 1;
+                clock_cycle(dut.get(), *dram);
+                dut->vec_swap = 0;
+                phase = START;
+                break;
+            case START:
+                dut->vdim = rows;
+                dut->hdim = hdim;
+                dut->use_dma = 1;
+                dut->dma_max_outstanding = 8;
+                dut->dma_fifo_beats = 64;
+                dut->dma_base = base;
+                dut->dma_length = num_beats * ROWS * LANES;
+                dut->dma_start = 1;
+                write_perf_counter(dut.get(), PERF_CTRL, PERF_CLEAR | PERF_ENABLE);
+                clock_cycle(dut.get(), *dram);
+                dut->dma_start = 0;
+                dut->csr_we = 0;
+                run_start = cycles;
+                phase = RUN;
+                break;
+            case RUN:
+                clock_cycle(dut.get(), *dram);
+                if (dut->out_valid) {
+                    get_results(dut->out_data, results);
+                }
+                if (results[0].size() >= groups * ROWS) {
+                    for (auto &r : results) r.resize(rows); // Drop the padding rows
+                    run_cycles = cycles + 1 - run_start;
+                    phase = DONE;
+                }
+                break;
+            case DONE:
+                break;
+        }
+    }
+
+    // After done(): read the core's counters, with the skipped cycles added back.
+    void read_counters() {
+        perf = read_perf_counters(dut.get(), [&]() { clock_cycle(dut.get(), *dram); });
+        perf.cycles += skipped;
+        perf.starved += skipped_starved;
+    }
+};
+
+// Barrier for a fixed number of threads. wait() returns the sum of the values passed by all
+// threads in this round, the same for every thread.
+class Barrier {
+public:
+    explicit Barrier(unsigned count) : count(count) {}
+
+    uint64_t wait(uint64_t value) {
+        std::unique_lock<std::mutex> lock(mutex);
+        uint64_t round = generation;
+        sum += value;
+        if (++waiting == count) {
+            result = sum;
+            sum = 0;
+            waiting = 0;
+            generation++;
+            cv.notify_all();
+        } else {
+            cv.wait(lock, [&]() { return generation != round; });
+        }
+        return result;
+    }
+
+private:
+    std::mutex mutex;
+    std::condition_variable cv;
+    unsigned count;
+    unsigned waiting = 0;
+    uint64_t generation = 0, sum = 0, result = 0;
+};
+
+/**
+ * Tensor-parallel layer: the rows of a rows x cols matrix are split evenly (in whole row groups)
+ * across cores, each with its own DRAM holding its slice, and the vectors are broadcast to all.
+ * Cores are stepped on the given number of threads, all advancing quantum cycles between
+ * barriers: 1 keeps them in lockstep, larger quanta synchronize loosely (the cores do not
+ * interact, so the results and cycle counts are the same). The partial outputs are gathered
+ * and checked; prints per-core utilization and the aggregate GMAC/s.
+ */
+static bool multicore(size_t cores, size_t rows, size_t cols, unsigned threads, uint64_t quantum) {
+#if WEIGHT_BITS != 8 || SPARSE
+    fprintf(stderr, "The multi-core simulation only supports dense 8-bit weights\n");
+    return false;
+#endif
+    const size_t groups = (rows + ROWS - 1) / ROWS;
+    if (cores == 0 || cores > groups || cols > (size_t)SRAM_DEPTH * VEC_LANES || rows > 65535) {
+        fprintf(stderr, "Cannot split %zu x %zu over %zu cores\n", rows, cols, cores);
+        return false;
+    }
+    threads = std::max(1u, std::min<unsigned>(threads, cores));
+
+    std::mt19937_64 rng(42);
+    std::vector<std::vector<uint8_t>> matrix(rows, std::vector<uint8_t>(cols));
+    std::vector<std::vector<uint8_t>> vectors(BATCH, std::vector<uint8_t>(cols));
+    for (auto &row : matrix) {
+        for (auto &v : row) v = rng();
+    }
+    for (auto &vec : vectors) {
+        for (auto &v : vec) v = rng();
+    }
+
+    std::vector<std::unique_ptr<SimCore>> sim(cores);
+    for (size_t k = 0; k < cores; k++) {
+        size_t first = groups * k / cores * ROWS;
+        size_t last = std::min(groups * (k + 1) / cores * ROWS, rows);
+        sim[k].reset(new SimCore(matrix, vectors, first, last - first));
+    }
+
+    // Core k runs on thread k % threads.
+    auto start = std::chrono::steady_clock::now();
+    Barrier barrier(threads);
+    auto worker = [&](unsigned t) {
+        for (;;) {
+            uint64_t done = 0;
+            for (size_t k = t; k < cores; k += threads) {
+                sim[k]->run(quantum);
+                done += sim[k]->done();
+            }
+            if (barrier.wait(done) == cores) break;
+        }
+        for (size_t k = t; k < cores; k += threads) {
+            sim[k]->read_counters();
+        }
+    };
+    std::vector<std::thread> pool;
+    for (unsigned t = 0; t < threads; t++) {
+        pool.emplace_back(worker, t);
+    }
+    for (std::thread &t : pool) {
+        t.join();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    // Gather the slices, and time the layer by the slowest core.
+    bool match = true;
+    uint64_t slowest = 0, fastest = UINT64_MAX;
+    for (const auto &core : sim) {
+        slowest = std::max(slowest, core->run_cycles);
+        fastest = std::min(fastest, core->run_cycles);
+    }
+    const double clock_ghz = DramTiming().clock_ghz;
+    const double peak = (double)LANES * ROWS * BATCH;
+    printf("Multi-core: %zu x %zu, batch %d, on %zu cores (%d lanes x %d rows), %u threads, quantum %llu cycles\n",
+           rows, cols, BATCH, cores, LANES, ROWS, threads, (unsigned long long)quantum);
+    printf("Core\tRows\tCycles\tBusy\tStarved\tUtil\n");
+    for (size_t k = 0; k < cores; k++) {
+        const SimCore &core = *sim[k];
+        double macs = (double)core.rows * cols * BATCH;
+        printf("%zu\t%zu\t%llu\t%u\t%u\t%.1f%%\n", k, core.rows, (unsigned long long)core.run_cycles,
+               core.perf.busy, core.perf.starved, 100.0 * macs / (slowest * peak));
+        match = match && core.perf.busy == core.num_beats && core.perf.row_groups == core.groups;
+    }
     std::vector<uint32_t> result;
-    result.reserve(matrix.size());
-    
-    for (size_t i = 0; i < matrix.size(); i++) {
-        uint32_t sum = 0;
-        for (size_t j = 0; j < vector.size(); j++) {
-            sum += static_cast<uint32_t>(matrix[i][j]) * static_cast<uint32_t>(vector[j]);
+    for (int b = 0; b < BATCH; b++) {
+        result.clear();
+        for (const auto &core : sim) {
+            result.insert(result.end(), core->results[b].begin(), core->results[b].end());
         }
-        result.push_back(sum);
+        match = match && result == sw_matmul(matrix, vectors[b]);
     }
-    
-    return result;
+    double macs = (double)rows * cols * BATCH;
+    printf("Layer: %llu cycles (slowest core), balance %.3f, %.1f GMAC/s at %.2f GHz (%.1f%% of %zu x %.0f MACs/cycle)\n",
+           (unsigned long long)slowest, (double)fastest / slowest, macs / slowest * clock_ghz, clock_ghz,
+           100.0 * macs / (slowest * peak * cores), cores, peak);
+    printf("Simulated in %.1f s, match: %s\n", seconds, match ? "Yes" : "No");
+    return match;
+}
+
+// Runtime backend (see runtime.h) on the Verilator model: one core with its DMAs and DRAM.
+class VerilatorBackend {
+public:
+    explicit VerilatorBackend(size_t dram_size) : dut(new Vmatmul_tb(&context)), dram_(dram_size, DramTiming()) {
+        dut->rst = 1;
+        dram_.in.rst = 1;
+        clock_cycle(dut.get(), dram_);
+        dut->rst = 0;
+        dram_.in.rst = 0;
+        dut->out_ready = 1;
+        dut->use_dma = 1;
+        dut->dma_max_outstanding = 8;
+        dut->dma_fifo_beats = 64;
+    }
+
+    Dram &dram() {
+        return dram_;
+    }
+
+    void load_vector(size_t addr, size_t bytes) {
+        dut->vec_dma_base = addr;
+        dut->vec_dma_length = bytes;
+        dut->vec_dma_start = 1;
+    }
+
+    bool vector_busy() const {
+        return dut->vec_dma_busy;
+    }
+
+    void swap() {
+        dut->vec_swap = 1;
+    }
+
+    void start(size_t addr, size_t bytes, size_t vdim, size_t hdim) {
+        dut->vdim = vdim;
+        dut->hdim = hdim;
+        dut->start = 1;
+        dut->dma_base = addr;
+        dut->dma_length = bytes;
+        dut->dma_start = 1;
+    }
+
+    // Skips idle DRAM waits; a row group can't be output during those.
+    bool step(std::vector<uint32_t> &group) {
+        uint64_t n = fast_forward(dut.get(), dram_, UINT64_MAX);
+        if (n > 0) {
+            cycles += n;
+            return false;
+        }
+        clock_cycle(dut.get(), dram_);
+        cycles++;
+        dut->vec_dma_start = 0;
+        dut->vec_swap = 0;
+        dut->start = 0;
+        dut->dma_start = 0;
+        if (!dut->out_valid) {
+            return false;
+        }
+        group.clear();
+        get_port(dut->out_data, group);
+        return true;
+    }
+
+    uint64_t cycle() const {
+        return cycles;
+    }
+
+private:
+    VerilatedContext context;
+    std::unique_ptr<Vmatmul_tb> dut;
+    Dram dram_;
+    uint64_t cycles = 0;
+};
+
+/**
+ * A layer through the runtime: y = matrix * x for the given number of vectors, which the runtime
+ * splits in batches and tiles. Prints the latency and checks the results.
+ */
+static bool runtime_layer(size_t rows, size_t cols, size_t vectors) {
+#if WEIGHT_BITS != 8 || SPARSE
+    fprintf(stderr, "The runtime only supports dense 8-bit weights\n");
+    return false;
+#endif
+    std::mt19937_64 rng(42);
+    std::vector<std::vector<uint8_t>> matrix(rows, std::vector<uint8_t>(cols));
+    std::vector<std::vector<uint8_t>> xs(vectors, std::vector<uint8_t>(cols));
+    for (auto &row : matrix) {
+        for (auto &v : row) v = rng();
+    }
+    std::vector<const uint8_t *> x_ptrs;
+    for (auto &x : xs) {
+        for (auto &v : x) v = rng();
+        x_ptrs.push_back(x.data());
+    }
+
+    VerilatorBackend backend(1ull << 32);
+    Runtime<VerilatorBackend> runtime(backend, core_config());
+    DeviceMatrix m = runtime.upload(matrix);
+    GemmResult result = runtime.gemm(m, x_ptrs).get();
+    Runtime<VerilatorBackend>::Stats stats = runtime.stats();
+
+    bool match = true;
+    for (size_t v = 0; v < vectors; v++) {
+        match = match && result.y[v] == sw_matmul(matrix, xs[v]);
+    }
+    uint64_t cycles = result.done_cycle - result.submit_cycle;
+    double clock_ghz = DramTiming().clock_ghz;
+    printf("Runtime: %zu x %zu, %zu vectors in batches of %d: %zu x %zu tiles, %llu descriptors\n",
+           rows, cols, vectors, BATCH, m.row_tiles, m.col_tiles, (unsigned long long)stats.descriptors);
+    printf("Latency: %llu cycles (%.1f us at %.2f GHz), %.2f MACs/cycle\n", (unsigned long long)cycles,
+           cycles / clock_ghz / 1000, clock_ghz, (double)rows * cols * vectors / cycles);
+    printf("Vector loads: %llu (%llu overlapped), %llu cycles waiting, match: %s\n",
+           (unsigned long long)stats.vector_loads, (unsigned long long)stats.overlapped_loads,
+           (unsigned long long)stats.vector_wait, match ? "Yes" : "No");
+    return match;
 }
 
-int main() {
+/**
+ * A 4-bit weight image quantized from floats (as bin/pack_weights writes it), mapped into DRAM
+ * and streamed through the core by the runtime. The core is configured with small limits, so
+ * that the matrix is split in row and column tiles.
+ */
+static bool q4_image_test(const char *argv0) {
+    std::cout << "4-bit weight image:" << std::endl;
+    CoreConfig config = core_config();
+    config.sram_depth = 4;
+    config.max_dim = 100;
+    const size_t rows = 250, cols = 300;
+    std::mt19937_64 rng(42);
+    std::vector<float> weights(rows * cols);
+    for (size_t i = 0; i < weights.size(); i++) {
+        // Groups of different magnitudes, for different group scales within a row.
+        weights[i] = ((int)(rng() % 2001) - 1000) / 1000.0f * (1 + i % cols / LANES % 4);
+    }
+    std::vector<uint8_t> x(cols);
+    for (auto &v : x) v = rng();
+    QuantTensor q = quantize("q4", weights.data(), rows, cols, 4, LANES);
+
+    std::string prefix = argv0;
+    prefix = prefix.substr(0, prefix.find_last_of('/') + 1) + "test_weights_q4";
+    WeightImageWriter writer(config);
+    VerilatorBackend backend(1 << 26);
+    std::vector<ImageTensor> image;
+    size_t image_end;
+    bool ok = writer.open(prefix) && writer.add(q) && writer.close() &&
+              load_weight_image(backend.dram(), (prefix + ".json").c_str(), config, &image, &image_end);
+    if (ok) {
+        Runtime<VerilatorBackend> runtime(backend, config, (image_end + 4095) & ~(size_t)4095, 1 << 20);
+        GemmResult result = runtime.gemv(image[0].matrix, x.data()).get();
+        ok = result.y[0] == sw_matmul_q4(q, x);
+        std::cout << "Tiles: " << image[0].matrix.row_tiles << " x " << image[0].matrix.col_tiles << ", cycles: "
+                  << result.done_cycle - result.submit_cycle << ", ";
+    }
+    std::cout << "match: " << (ok ? "Yes" : "No") << std::endl;
+    return ok;
+}
+
+// Usage: Vmatmul_tb, or Vmatmul_tb regress [cases [first_seed [threads]]] for randomized regression,
+// or Vmatmul_tb bench [prefix [model [threads]]] for the LLM layer benchmark,
+// or Vmatmul_tb multicore [cores [rows cols [threads [quantum]]]] for a tensor-parallel layer,
+// or Vmatmul_tb runtime [rows cols [vectors]] for a layer through the host runtime.
+int main(int argc, char **argv) {
+    if (argc > 1 && !strcmp(argv[1], "regress")) {
+        size_t cases = argc > 2 ? strtoull(argv[2], NULL, 0) : 1000;
+        uint64_t seed = argc > 3 ? strtoull(argv[3], NULL, 0) : 1;
+        unsigned threads = argc > 4 ? strtoul(argv[4], NULL, 0) : std::max(1u, std::thread::hardware_concurrency());
+        return regress(cases, seed, threads) ? 0 : 1;
+    }
+    if (argc > 1 && !strcmp(argv[1], "bench")) {
+        const char *prefix = argc > 2 ? argv[2] : "bench";
+        const char *model = argc > 3 ? argv[3] : "all";
+        unsigned threads = argc > 4 ? strtoul(argv[4], NULL, 0) : std::max(1u, std::thread::hardware_concurrency());
+        return bench(prefix, model, threads) ? 0 : 1;
+    }
+    if (argc > 1 && !strcmp(argv[1], "multicore")) {
+        size_t cores = argc > 2 ? strtoull(argv[2], NULL, 0) : 8;
+        size_t rows = argc > 4 ? strtoull(argv[3], NULL, 0) : 4096;
+        size_t cols = argc > 4 ? strtoull(argv[4], NULL, 0) : 4096;
+        unsigned threads = argc > 5 ? strtoul(argv[5], NULL, 0) : std::max(1u, std::thread::hardware_concurrency());
+        uint64_t quantum = argc > 6 ? strtoull(argv[6], NULL, 0) : 1000;
+        return multicore(cores, rows, cols, threads, quantum) ? 0 : 1;
+    }
+    if (argc > 1 && !strcmp(argv[1], "runtime")) {
+        size_t rows = argc > 3 ? strtoull(argv[2], NULL, 0) : 4096;
+        size_t cols = argc > 3 ? strtoull(argv[3], NULL, 0) : 11008;
+        size_t vectors = argc > 4 ? strtoull(argv[4], NULL, 0) : 1;
+        return runtime_layer(rows, cols, vectors) ? 0 : 1;
+    }
+#if WEIGHT_BITS == 4
+    bool q4_ok = q4_tests();
+    q4_ok = q4_image_test(argv[0]) && q4_ok;
+    return q4_ok ? 0 : 1;
+#elif SPARSE
+    return sparse_tests() ? 0 : 1;
+#else
     // Define a 3x4 matrix and a 4-element vector
     std::vector<std::vector<uint8_t>> matrix = {
         {1, 2, 3, 4},
@@ -136,6 +1836,220 @@ int main() {
     
     std::cout << "----------------------------------------" << std::endl;
     std::cout << "Overall match: " << (all_match ? "Yes" : "No") << std::endl;
-    
-    return 0;
+
+    // Stream a larger matrix from DRAM through the DMA, with different prefetch limits.
+    std::cout << "\nDMA from DRAM:" << std::endl;
+    srand(42);
+    std::vector<std::vector<uint8_t>> big_matrix(64, std::vector<uint8_t>(80));
+    std::vector<uint8_t> big_vector(80);
+    for (auto &row : big_matrix) {
+        for (auto &v : row) v = rand() & 0xFF;
+    }
+    for (auto &v : big_vector) v = rand() & 0xFF;
+    std::vector<uint32_t> big_expected = sw_matmul(big_matrix, big_vector);
+
+    const int configs[][2] = {{1, 16}, {2, 32}, {4, 64}, {8, 64}};
+    // The core's counters see every beat and result; its starved count covers the same cycles,
+    // but from the core's side of the clock edge.
+    std::cout << "Outstanding\tFIFO\tCycles\tStarved\tHW starved\tMatch" << std::endl;
+    const size_t big_beats = (big_matrix.size() + ROWS - 1) / ROWS * row_beats(big_vector.size());
+    for (const auto &cfg : configs) {
+        DmaRun run = hw_matmul_dma(big_matrix, big_vector, cfg[0], cfg[1], DramTiming());
+        bool match = run.results == big_expected && run.perf.busy == big_beats &&
+                     run.perf.sram_reads == big_beats && run.perf.row_groups == (big_matrix.size() + ROWS - 1) / ROWS;
+        std::cout << cfg[0] << "\t\t" << cfg[1] << "\t" << run.cycles << "\t" << run.starved << "\t"
+                  << run.perf.starved << "\t\t" << (match ? "Yes" : "No") << std::endl;
+        if (!match) all_match = false;
+    }
+
+    // Several layers in a row, loading the next vector during compute or in between.
+    std::cout << "\nVector double buffering:" << std::endl;
+    const int layers = 4;
+    std::vector<std::vector<std::vector<uint8_t>>> layer_matrices(layers, std::vector<std::vector<uint8_t>>(64, std::vector<uint8_t>(200)));
+    std::vector<std::vector<uint8_t>> layer_vectors(layers, std::vector<uint8_t>(200));
+    std::vector<uint32_t> layer_expected;
+    for (int l = 0; l < layers; l++) {
+        for (auto &row : layer_matrices[l]) {
+            for (auto &v : row) v = rand() & 0xFF;
+        }
+        for (auto &v : layer_vectors[l]) v = rand() & 0xFF;
+        std::vector<uint32_t> expected = sw_matmul(layer_matrices[l], layer_vectors[l]);
+        layer_expected.insert(layer_expected.end(), expected.begin(), expected.end());
+    }
+    DmaRun serial = hw_matmul_layers(layer_matrices, layer_vectors, false);
+    DmaRun overlapped = hw_matmul_layers(layer_matrices, layer_vectors, true);
+    bool layers_match = serial.results == layer_expected && overlapped.results == layer_expected;
+    std::cout << "Serial load: " << serial.cycles << " cycles, overlapped load: " << overlapped.cycles
+              << " cycles, match: " << (layers_match ? "Yes" : "No") << std::endl;
+    if (!layers_match || overlapped.cycles >= serial.cycles) all_match = false;
+
+    // Several vectors against one pass over the matrix.
+    std::cout << "\nBatch of " << BATCH << " vectors:" << std::endl;
+    std::vector<std::vector<uint8_t>> batch_vectors(BATCH, std::vector<uint8_t>(200));
+    for (auto &vec : batch_vectors) {
+        for (auto &v : vec) v = rand() & 0xFF;
+    }
+    uint64_t batch_cycles;
+    std::vector<std::vector<uint32_t>> batch_results = hw_matmul_batch(layer_matrices[0], batch_vectors, &batch_cycles);
+    bool batch_match = true;
+    for (int b = 0; b < BATCH; b++) {
+        batch_match = batch_match && batch_results[b] == sw_matmul(layer_matrices[0], batch_vectors[b]);
+    }
+    std::cout << "Cycles: " << batch_cycles << ", MACs/cycle: "
+              << (double)BATCH * layer_matrices[0].size() * batch_vectors[0].size() / batch_cycles
+              << ", match: " << (batch_match ? "Yes" : "No") << std::endl;
+    if (!batch_match) all_match = false;
+
+    // Requantized int8 output with each activation, with one scale and with per-row scales.
+    // 61 rows, so that the last output beat is partial.
+    std::cout << "\nRequantized output:" << std::endl;
+    std::vector<std::vector<uint8_t>> rq_matrix(layer_matrices[0].begin(), layer_matrices[0].begin() + 61);
+    std::vector<std::vector<uint32_t>> rq_results;
+    uint64_t rq_sum = 0;
+    for (const auto &vec : batch_vectors) {
+        rq_results.push_back(sw_matmul(rq_matrix, vec));
+        for (uint32_t x : rq_results.back()) rq_sum += x;
+    }
+    Requant rq;
+    rq.offset = rq_sum / (rq_results.size() * rq_matrix.size()); // Center the results around 0
+    rq.scale = 200;
+    rq.shift = 20;
+    std::cout << "Activation\tScales\tBytes\tMatch" << std::endl;
+    const char *act_names[] = {"none", "ReLU", "SiLU"};
+    for (Activation act : {ACT_NONE, ACT_RELU, ACT_SILU}) {
+        for (bool per_row : {false, true}) {
+            rq.act = act;
+            rq.row_scales.clear();
+            if (per_row) {
+                for (size_t row = 0; row < rq_matrix.size(); row++) rq.row_scales.push_back(100 + rand() % 200);
+            }
+            std::vector<uint8_t> bytes;
+            uint64_t cycles;
+            hw_matmul_stream(pack_matrix(rq_matrix, 200), rq_matrix.size(), batch_vectors, &cycles, &rq, &bytes);
+            // The output holds the padding rows too, in whole beats.
+            std::vector<uint8_t> expected = sw_requant(rq_results, rq);
+            size_t values = (rq_matrix.size() + ROWS - 1) / ROWS * ROWS * BATCH;
+            bool match = bytes.size() == (values + 31) / 32 * 32 &&
+                         std::equal(expected.begin(), expected.end(), bytes.begin());
+            std::cout << act_names[act] << "\t\t" << (per_row ? "row" : "tensor") << "\t" << bytes.size() << "\t"
+                      << (match ? "Yes" : "No") << std::endl;
+            if (!match) all_match = false;
+        }
+    }
+
+    // Transposed mode, e.g. attention weights times the V cache (tokens x head dim). The single
+    // beat rows add to the word written in the cycle before. All run on one core, so each matrix
+    // must also clear the result of the one before.
+    std::cout << "\nTransposed (vector x matrix):" << std::endl;
+    const size_t t_shapes[][2] = {{100, 20}, {1, 200}, {300, 128}, {4096, 64}};
+    std::vector<std::vector<std::vector<uint8_t>>> t_matrices;
+    std::vector<std::vector<uint8_t>> t_vectors;
+    for (const auto &shape : t_shapes) {
+        t_matrices.emplace_back(shape[0], std::vector<uint8_t>(shape[1]));
+        for (auto &row : t_matrices.back()) {
+            for (auto &v : row) v = rand() & 0xFF;
+        }
+        t_vectors.emplace_back(shape[0]);
+        for (auto &v : t_vectors.back()) v = rand() & 0xFF;
+    }
+    std::vector<std::vector<uint32_t>> t_results = hw_matmul_t(t_matrices, t_vectors);
+    std::cout << "Tokens\tDim\tMatch" << std::endl;
+    for (size_t m = 0; m < t_matrices.size(); m++) {
+        bool match = t_results[m] == sw_matmul_t(t_matrices[m], t_vectors[m]);
+        std::cout << t_shapes[m][0] << "\t" << t_shapes[m][1] << "\t" << (match ? "Yes" : "No") << std::endl;
+        if (!match) all_match = false;
+    }
+
+    // Randomized tests at LLM layer shapes (hidden x hidden, and the FFN down projection).
+    // Rows are split in tiles of 2048 columns (fewer if the vector SRAM is smaller), so that
+    // both shapes add up partial sums of several tiles whatever the SRAM size.
+    std::cout << "\nLLM shapes:" << std::endl;
+    const size_t shapes[][2] = {{4096, 4096}, {4096, 11008}};
+    std::cout << "Rows\tCols\tTiles\tCycles\tMACs/cycle\tMatch" << std::endl;
+    for (const auto &shape : shapes) {
+        std::vector<std::vector<uint8_t>> llm_matrix(shape[0], std::vector<uint8_t>(shape[1]));
+        std::vector<uint8_t> llm_vector(shape[1]);
+        for (auto &row : llm_matrix) {
+            for (auto &v : row) v = rand() & 0xFF;
+        }
+        for (auto &v : llm_vector) v = rand() & 0xFF;
+        size_t tile_cols = std::min<size_t>(2048, SRAM_DEPTH * LANES);
+        DmaRun run = hw_matmul_tiled(llm_matrix, llm_vector, tile_cols);
+        bool match = run.results == sw_matmul(llm_matrix, llm_vector);
+        std::cout << shape[0] << "\t" << shape[1] << "\t" << (shape[1] + tile_cols - 1) / tile_cols << "\t"
+                  << run.cycles << "\t" << (double)shape[0] * shape[1] / run.cycles << "\t\t"
+                  << (match ? "Yes" : "No") << std::endl;
+        if (!match) all_match = false;
+    }
+
+    // Two jobs queued at once through the runtime, on a core configured with small limits so
+    // that both matrices are split in row and column tiles.
+    std::cout << "\nRuntime:" << std::endl;
+    {
+        CoreConfig config = core_config();
+        config.sram_depth = 4;
+        config.max_dim = 100;
+        VerilatorBackend backend(1 << 26);
+        Runtime<VerilatorBackend> runtime(backend, config, 0x10000, 1 << 20);
+        std::vector<std::vector<uint8_t>> rt_matrix(250, std::vector<uint8_t>(300));
+        std::vector<std::vector<uint8_t>> rt_xs(BATCH + 1, std::vector<uint8_t>(300));
+        std::vector<const uint8_t *> rt_ptrs;
+        for (auto &row : rt_matrix) {
+            for (auto &v : row) v = rand() & 0xFF;
+        }
+        for (auto &x : rt_xs) {
+            for (auto &v : x) v = rand() & 0xFF;
+            rt_ptrs.push_back(x.data());
+        }
+        DeviceMatrix m0 = runtime.upload(rt_matrix);
+        DeviceMatrix m1 = runtime.upload(layer_matrices[0]);
+        std::future<GemmResult> gemm = runtime.gemm(m0, rt_ptrs);
+        std::future<GemmResult> gemv = runtime.gemv(m1, layer_vectors[0].data());
+        GemmResult gemm_result = gemm.get();
+        GemmResult gemv_result = gemv.get();
+        Runtime<VerilatorBackend>::Stats stats = runtime.stats();
+        bool match = gemv_result.y[0] == sw_matmul(layer_matrices[0], layer_vectors[0]) &&
+                     gemv_result.done_cycle > gemm_result.done_cycle && stats.overlapped_loads > 0;
+        for (size_t v = 0; v < rt_xs.size(); v++) {
+            match = match && gemm_result.y[v] == sw_matmul(rt_matrix, rt_xs[v]);
+        }
+        std::cout << "Tiles: " << m0.row_tiles << " x " << m0.col_tiles << " and " << m1.row_tiles << " x "
+                  << m1.col_tiles << ", descriptors: " << stats.descriptors << ", vector loads: "
+                  << stats.vector_loads << " (" << stats.overlapped_loads << " overlapped), cycles: "
+                  << gemv_result.done_cycle - gemm_result.submit_cycle << ", match: " << (match ? "Yes" : "No")
+                  << std::endl;
+        if (!match) all_match = false;
+
+        // The same matrix quantized from floats into a weight image next to this binary (as
+        // bin/pack_weights writes it), mapped into a fresh DRAM and streamed by the runtime.
+        std::vector<float> weights;
+        for (const auto &row : rt_matrix) {
+            for (uint8_t v : row) weights.push_back(((int)v - 128) / 64.0f);
+        }
+        QuantTensor q = quantize("rt", weights.data(), rt_matrix.size(), 300, 8, LANES);
+        std::string prefix = argv[0];
+        prefix = prefix.substr(0, prefix.find_last_of('/') + 1) + "test_weights";
+        WeightImageWriter writer(config);
+        bool image_ok = writer.open(prefix) && writer.add(q) && writer.close();
+        VerilatorBackend image_backend(1 << 26);
+        std::vector<ImageTensor> image;
+        size_t image_end;
+        image_ok = image_ok && load_weight_image(image_backend.dram(), (prefix + ".json").c_str(), config, &image,
+                                                 &image_end);
+        std::vector<std::vector<uint8_t>> q_rows;
+        for (size_t r = 0; r < q.rows; r++) {
+            q_rows.emplace_back(&q.q[r * q.cols], &q.q[(r + 1) * q.cols]);
+        }
+        if (image_ok) {
+            Runtime<VerilatorBackend> image_runtime(image_backend, config, (image_end + 4095) & ~(size_t)4095, 1 << 20);
+            GemmResult image_result = image_runtime.gemv(image[0].matrix, rt_xs[0].data()).get();
+            image_ok = image_result.y[0] == sw_matmul(q_rows, rt_xs[0]);
+        }
+        std::cout << "Weight image: " << (image_ok ? image[0].matrix.addr.size() : 0) << " tiles, match: "
+                  << (image_ok ? "Yes" : "No") << std::endl;
+        if (!image_ok) all_match = false;
+    }
+
+    return all_match ? 0 : 1;
+#endif
 }
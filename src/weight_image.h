@@ -0,0 +1,391 @@
+#ifndef WEIGHT_IMAGE_H
+#define WEIGHT_IMAGE_H
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+
+#include "dram.h"
+#include "json.h"
+#include "runtime.h"
+
+/**
+ * DRAM images of quantized weights, laid out once offline in the order the core
+ * streams them, so that a run maps the file and starts bursting.
+ *
+ * An image is two files: prefix.bin, mapped into DRAM at the base address, and
+ * prefix.json, the manifest. Every matrix is split in tiles like the runtime
+ * does (see runtime.h), each packed in the core's beat order and starting on a
+ * 4 KB boundary, so no burst crosses one. Per-row float scales follow the tiles.
+ *
+ * Weights are unsigned, as the core multiplies them: int8 weights are stored
+ * with a zero point of 128, grouped int4 weights with 8 and a 16-bit scale per
+ * group of lanes columns (the hardware's group). A row dequantizes as
+ *   8 bit: y = row_scale * (result - 128 * sum(x))
+ *   4 bit: y = row_scale * (result - 8 * sum over groups of (scale * sum(x in group)) >> 8)
+ */
+
+// A quantized matrix. q holds one weight per byte, row by row.
+typedef struct QuantTensor {
+    std::string name;
+    int bits = 8;
+    size_t rows = 0, cols = 0;
+    std::vector<uint8_t> q;
+    std::vector<uint16_t> group_scales;    // 4 bit: rows x groups, groups of lanes columns
+    std::vector<float> row_scales;
+    int zero_point = 128;
+} QuantTensor;
+
+// A matrix in a loaded image. The tiles in matrix can be passed to the runtime as is (8 bit).
+typedef struct ImageTensor {
+    std::string name;
+    int bits = 8;
+    int zero_point = 128;
+    size_t scales_addr = 0;     // rows float32 row scales
+    DeviceMatrix matrix;
+} ImageTensor;
+
+/**
+ * Quantize a row-major float matrix: int8 with a symmetric scale per row, or int4 with a
+ * symmetric scale per group of group columns, stored relative to the largest one of the row.
+ */
+inline QuantTensor quantize(const std::string &name, const float *w, size_t rows, size_t cols, int bits, size_t group) {
+    assert(bits == 8 || bits == 4);
+    QuantTensor t;
+    t.name = name;
+    t.bits = bits;
+    t.rows = rows;
+    t.cols = cols;
+    t.q.resize(rows * cols);
+    t.row_scales.resize(rows);
+    t.zero_point = bits == 8 ? 128 : 8;
+    const int qmax = bits == 8 ? 127 : 7;
+    size_t groups = (cols + group - 1) / group;
+    if (bits == 4) {
+        t.group_scales.resize(rows * groups);
+    }
+    std::vector<float> scales(groups);
+    for (size_t r = 0; r < rows; r++) {
+        const float *row = w + r * cols;
+        size_t n = bits == 8 ? 1 : groups;
+        size_t width = bits == 8 ? cols : group;
+        float largest = 0;
+        for (size_t g = 0; g < n; g++) {
+            float m = 0;
+            for (size_t c = g * width; c < std::min(cols, (g + 1) * width); c++) {
+                m = std::max(m, std::fabs(row[c]));
+            }
+            scales[g] = m / qmax;
+            largest = std::max(largest, scales[g]);
+        }
+        if (largest == 0) {
+            largest = 1;
+        }
+        // 4 bit: group scale k = s_g / s_max * 65535 applied as k / 256 by the core.
+        t.row_scales[r] = bits == 8 ? largest : largest * 256 / 65535;
+        for (size_t g = 0; g < n; g++) {
+            float s = scales[g] > 0 ? scales[g] : largest;
+            if (bits == 4) {
+                t.group_scales[r * groups + g] = (uint16_t)std::lround(scales[g] / largest * 65535);
+            }
+            for (size_t c = g * width; c < std::min(cols, (g + 1) * width); c++) {
+                long v = std::lround(row[c] / s);
+                v = std::max<long>(-qmax - (bits == 4), std::min<long>(qmax, v));
+                t.q[r * cols + c] = (uint8_t)(v + t.zero_point);
+            }
+        }
+    }
+    return t;
+}
+
+/**
+ * Rows [row0, row0+vdim) and columns [col0, col0+hdim) of a 4-bit matrix in the layout the
+ * core expects: like pack_tile, with two weights per byte (low nibble first), and a scale beat
+ * before every run of lanes / 4 weight beats of a group of rows. col0 is a multiple of lanes.
+ */
+inline std::vector<uint8_t> pack_q4_tile(const CoreConfig &config, const QuantTensor &t,
+                                         size_t row0, size_t vdim, size_t col0, size_t hdim) {
+    const size_t lanes = config.lanes;
+    const size_t row_bytes = lanes / 2;
+    const size_t beat_bytes = config.rows * row_bytes;
+    const size_t scales_per_beat = lanes / 4;
+    const size_t groups = (t.cols + lanes - 1) / lanes;
+    size_t beats = (hdim + lanes - 1) / lanes;
+    assert(col0 % lanes == 0);
+    std::vector<uint8_t> packed;
+    for (size_t first = 0; first < vdim; first += config.rows) {
+        for (size_t run = 0; run < beats; run += scales_per_beat) {
+            size_t run_beats = std::min(beats - run, scales_per_beat);
+            std::vector<uint8_t> beat(beat_bytes, 0);
+            for (size_t r = 0; r < config.rows && first + r < vdim; r++) {
+                for (size_t k = 0; k < run_beats; k++) {
+                    uint16_t scale = t.group_scales[(row0 + first + r) * groups + col0 / lanes + run + k];
+                    memcpy(&beat[r * row_bytes + 2 * k], &scale, 2);
+                }
+            }
+            packed.insert(packed.end(), beat.begin(), beat.end());
+
+            for (size_t k = 0; k < run_beats; k++) {
+                std::fill(beat.begin(), beat.end(), 0);
+                for (size_t r = 0; r < config.rows && first + r < vdim; r++) {
+                    const uint8_t *row = &t.q[(row0 + first + r) * t.cols + col0];
+                    for (size_t i = 0; i < lanes && (run + k) * lanes + i < hdim; i++) {
+                        uint8_t q = row[(run + k) * lanes + i];
+                        assert(q < 16);
+                        beat[r * row_bytes + i / 2] |= q << (4 * (i % 2));
+                    }
+                }
+                packed.insert(packed.end(), beat.begin(), beat.end());
+            }
+        }
+    }
+    return packed;
+}
+
+// Writes an image tensor by tensor, without holding it in memory.
+class WeightImageWriter {
+public:
+    WeightImageWriter(const CoreConfig &config, size_t base = 0x10000) : config(config), base(base) {
+        assert(base % DramStorage::PAGE_SIZE == 0);
+    }
+
+    ~WeightImageWriter() {
+        if (image) {
+            fclose(image);
+        }
+    }
+
+    bool open(const std::string &output_prefix) {
+        prefix = output_prefix;
+        image = fopen((prefix + ".bin").c_str(), "wb");
+        if (!image) {
+            perror((prefix + ".bin").c_str());
+            return false;
+        }
+        return true;
+    }
+
+    bool add(const QuantTensor &t) {
+        assert(image && t.q.size() == t.rows * t.cols && t.row_scales.size() == t.rows);
+        assert(t.bits == 8 || t.group_scales.size() == t.rows * ((t.cols + config.lanes - 1) / config.lanes));
+        ImageTensor entry;
+        entry.name = t.name;
+        entry.bits = t.bits;
+        entry.zero_point = t.zero_point;
+        DeviceMatrix &m = entry.matrix;
+        m.rows = t.rows;
+        m.cols = t.cols;
+        m.tile_rows = config.max_rows();
+        m.tile_cols = config.max_cols() / config.lanes * config.lanes;
+        m.row_tiles = (m.rows + m.tile_rows - 1) / m.tile_rows;
+        m.col_tiles = (m.cols + m.tile_cols - 1) / m.tile_cols;
+        std::vector<std::vector<uint8_t>> rows;
+        for (size_t r = 0; r < m.row_tiles; r++) {
+            if (t.bits == 8) {
+                // pack_tile takes rows; copy only this row tile's.
+                rows.assign(m.tile_vdim(r), std::vector<uint8_t>());
+                for (size_t i = 0; i < rows.size(); i++) {
+                    const uint8_t *row = &t.q[(r * m.tile_rows + i) * t.cols];
+                    rows[i].assign(row, row + t.cols);
+                }
+            }
+            for (size_t c = 0; c < m.col_tiles; c++) {
+                std::vector<uint8_t> packed = t.bits == 8 ?
+                    pack_tile(config, rows, 0, m.tile_vdim(r), c * m.tile_cols, m.tile_hdim(c)) :
+                    pack_q4_tile(config, t, r * m.tile_rows, m.tile_vdim(r), c * m.tile_cols, m.tile_hdim(c));
+                m.addr.push_back(base + offset);
+                m.bytes.push_back(packed.size());
+                if (!append(packed.data(), packed.size())) {
+                    return false;
+                }
+            }
+        }
+        entry.scales_addr = base + offset;
+        if (!append(t.row_scales.data(), t.rows * sizeof(float))) {
+            return false;
+        }
+        tensors.push_back(entry);
+        return true;
+    }
+
+    // Finish the image and write the manifest.
+    bool close() {
+        bool ok = fclose(image) == 0;
+        image = nullptr;
+        std::string path = prefix + ".json";
+        FILE *f = fopen(path.c_str(), "w");
+        if (!ok || !f) {
+            perror(path.c_str());
+            return false;
+        }
+        std::string name = prefix.substr(prefix.find_last_of('/') + 1) + ".bin";
+        fprintf(f, "{\n  \"image\": \"%s\",\n  \"base\": %zu,\n  \"size\": %zu,\n", escape(name).c_str(), base, offset);
+        fprintf(f, "  \"core\": {\"lanes\": %zu, \"rows\": %zu, \"sram_depth\": %zu, \"max_dim\": %zu},\n",
+                config.lanes, config.rows, config.sram_depth, config.max_dim);
+        fprintf(f, "  \"tensors\": [");
+        for (size_t i = 0; i < tensors.size(); i++) {
+            const ImageTensor &t = tensors[i];
+            const DeviceMatrix &m = t.matrix;
+            fprintf(f, "%s\n    {\"name\": \"%s\", \"bits\": %d, \"zero_point\": %d, \"rows\": %zu, \"cols\": %zu, "
+                       "\"scales\": %zu, \"tile_rows\": %zu, \"tile_cols\": %zu, \"tiles\": [",
+                    i ? "," : "", escape(t.name).c_str(), t.bits, t.zero_point, m.rows, m.cols, t.scales_addr,
+                    m.tile_rows, m.tile_cols);
+            for (size_t k = 0; k < m.addr.size(); k++) {
+                fprintf(f, "%s[%zu, %zu]", k ? ", " : "", m.addr[k], m.bytes[k]);
+            }
+            fprintf(f, "]}");
+        }
+        fprintf(f, "\n  ]\n}\n");
+        return fclose(f) == 0;
+    }
+
+    size_t end() const {
+        return base + offset;
+    }
+
+private:
+    CoreConfig config;
+    size_t base;
+    size_t offset = 0;
+    std::string prefix;
+    FILE *image = nullptr;
+    std::vector<ImageTensor> tensors;
+
+    // Append data at the current offset, and pad to the next 4 KB boundary.
+    bool append(const void *data, size_t length) {
+        static const uint8_t zeros[4096] = {};
+        size_t pad = (4096 - length % 4096) % 4096;
+        if (fwrite(data, 1, length, image) != length || fwrite(zeros, 1, pad, image) != pad) {
+            perror((prefix + ".bin").c_str());
+            return false;
+        }
+        offset += length + pad;
+        return true;
+    }
+
+    static std::string escape(const std::string &s) {
+        std::string out;
+        for (char c : s) {
+            if (c == '"' || c == '\\') {
+                out.push_back('\\');
+            }
+            out.push_back(c);
+        }
+        return out;
+    }
+};
+
+/**
+ * Map the image of a manifest into DRAM at its base address, and read its tensors.
+ * The image file is looked up next to the manifest. Fails (with a message) if the
+ * image was packed for another core shape, or if a tile or the scales of a tensor
+ * lie outside the image. *end is the first address after the image.
+ */
+inline bool load_weight_image(Dram &dram, const char *manifest, const CoreConfig &config,
+                              std::vector<ImageTensor> *tensors, size_t *end) {
+    FILE *f = fopen(manifest, "rb");
+    if (!f) {
+        perror(manifest);
+        return false;
+    }
+    std::string text;
+    char buffer[65536];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), f)) > 0) {
+        text.append(buffer, n);
+    }
+    fclose(f);
+
+    Json root;
+    size_t error = 0;
+    if (!Json::parse(text.data(), text.size(), &root, &error)) {
+        fprintf(stderr, "%s: invalid JSON at offset %zu\n", manifest, error);
+        return false;
+    }
+    const Json *core = root.get("core");
+    const Json *list = root.get("tensors");
+    if (!core || !list || list->type != Json::ARRAY || root.get_string("image").empty()) {
+        fprintf(stderr, "%s: not a weight image manifest\n", manifest);
+        return false;
+    }
+    if (core->get_integer("lanes") != config.lanes || core->get_integer("rows") != config.rows ||
+        core->get_integer("sram_depth") != config.sram_depth || core->get_integer("max_dim") != config.max_dim) {
+        fprintf(stderr, "%s: packed for another core configuration\n", manifest);
+        return false;
+    }
+
+    std::string path = manifest;
+    size_t slash = path.find_last_of('/');
+    path = (slash == std::string::npos ? std::string() : path.substr(0, slash + 1)) + root.get_string("image");
+    size_t base = root.get_integer("base");
+    size_t size = root.get_integer("size");
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0 || (size_t)st.st_size != size) {
+        fprintf(stderr, "%s: %s is not the %zu byte image of the manifest\n", manifest, path.c_str(), size);
+        return false;
+    }
+    if (base % DramStorage::PAGE_SIZE != 0 || !dram.data.map_file(path.c_str(), base)) {
+        fprintf(stderr, "%s: cannot map %s at 0x%zx\n", manifest, path.c_str(), base);
+        return false;
+    }
+    *end = base + size;
+    // Whether [addr, addr + bytes) lies in the image.
+    auto inside = [&](size_t addr, size_t bytes) {
+        return addr >= base && bytes <= size && addr - base <= size - bytes;
+    };
+
+    tensors->clear();
+    for (const Json &entry : list->array) {
+        ImageTensor t;
+        t.name = entry.get_string("name");
+        t.bits = (int)entry.get_integer("bits");
+        t.zero_point = (int)entry.get_integer("zero_point");
+        t.scales_addr = entry.get_integer("scales");
+        DeviceMatrix &m = t.matrix;
+        m.rows = entry.get_integer("rows");
+        m.cols = entry.get_integer("cols");
+        m.tile_rows = entry.get_integer("tile_rows");
+        m.tile_cols = entry.get_integer("tile_cols");
+        const Json *tiles = entry.get("tiles");
+        if (m.rows == 0 || m.cols == 0 || m.tile_rows == 0 || m.tile_cols == 0 || !tiles ||
+            (t.bits != 8 && t.bits != 4)) {
+            fprintf(stderr, "%s: invalid tensor \"%s\"\n", manifest, t.name.c_str());
+            return false;
+        }
+        if (m.rows > size / sizeof(float) || !inside(t.scales_addr, m.rows * sizeof(float))) {
+            fprintf(stderr, "%s: scales of tensor \"%s\" outside the image\n", manifest, t.name.c_str());
+            return false;
+        }
+        m.row_tiles = (m.rows + m.tile_rows - 1) / m.tile_rows;
+        m.col_tiles = (m.cols + m.tile_cols - 1) / m.tile_cols;
+        for (const Json &tile : tiles->array) {
+            if (tile.array.size() != 2 || !tile.array[0].is_integer || !tile.array[1].is_integer) {
+                break;
+            }
+            if (!inside(tile.array[0].integer, tile.array[1].integer)) {
+                fprintf(stderr, "%s: tile at 0x%zx of tensor \"%s\" outside the image\n", manifest,
+                        (size_t)tile.array[0].integer, t.name.c_str());
+                return false;
+            }
+            m.addr.push_back(tile.array[0].integer);
+            m.bytes.push_back(tile.array[1].integer);
+        }
+        if (m.addr.size() != m.row_tiles * m.col_tiles) {
+            fprintf(stderr, "%s: tensor \"%s\" has %zu tiles, expected %zu\n", manifest, t.name.c_str(),
+                    m.addr.size(), m.row_tiles * m.col_tiles);
+            return false;
+        }
+        tensors->push_back(t);
+    }
+    return true;
+}
+
+#endif
@@ -0,0 +1,199 @@
+#ifndef WRITE_COMBINER_H
+#define WRITE_COMBINER_H
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "dram.h"
+
+/**
+ * Write-combining buffer in front of the Dram write channels.
+ *
+ * Small writes (e.g. 32-bit results) are merged into bus-wide lines. A line
+ * is written out as a single full beat as soon as all its bytes are present,
+ * or with byte strobes when it is evicted (buffer full, or flush()).
+ *
+ * Call tick() before every Dram clock cycle; it drives the AW/W/B inputs and
+ * assumes the clock edge follows. Don't call write() between tick() and the
+ * clock edge, the line being sent may be reused.
+ */
+class WriteCombiner {
+public:
+    typedef struct Stats {
+        uint64_t writes = 0;        // Calls to write()
+        uint64_t full_beats = 0;    // Lines written with all bytes present
+        uint64_t partial_beats = 0; // Lines evicted with only some bytes present
+    } Stats;
+    Stats stats;
+
+    WriteCombiner(int num_lines = 8, int line_bytes = 32) : line_bytes(line_bytes) {
+        assert(line_bytes > 0 && line_bytes <= 64 && (line_bytes & (line_bytes - 1)) == 0);
+        full_mask = line_bytes == 64 ? ~0ull : (1ull << line_bytes) - 1;
+        lines.resize(num_lines);
+        for (Line &line : lines) {
+            line.data.resize(line_bytes);
+        }
+        queue.resize(num_lines);
+    }
+
+    /**
+     * Write bytes that lie within one line. Returns false if the buffer has
+     * no room for a new line; the oldest line is then evicted and the caller
+     * should retry on a later cycle.
+     */
+    bool write(size_t address, const void *src, size_t length) {
+        assert(length > 0 && address % line_bytes + length <= (size_t)line_bytes);
+        size_t tag = address / line_bytes;
+        Line *line = find(tag);
+        if (!line) {
+            line = allocate(tag);
+            if (!line) {
+                evict_oldest();
+                return false;
+            }
+        }
+        size_t offset = address % line_bytes;
+        memcpy(&line->data[offset], src, length);
+        line->mask |= (length == 64 ? ~0ull : (1ull << length) - 1) << offset;
+        stats.writes++;
+        if (line->mask == full_mask) {
+            enqueue(*line);
+        }
+        return true;
+    }
+
+    // Write out all lines, including partially filled ones.
+    void flush() {
+        for (Line &line : lines) {
+            if (line.state == FILLING) {
+                enqueue(line);
+            }
+        }
+    }
+
+    // True when all data has been written and acknowledged by the Dram.
+    bool idle() const {
+        for (const Line &line : lines) {
+            if (line.state != FREE) return false;
+        }
+        return outstanding == 0;
+    }
+
+    // Drive the Dram write channels for the next clock cycle.
+    void tick(Dram &dram) {
+        Dram::Input &in = dram.in;
+        in.bready = true;
+        in.awvalid = false;
+        in.wvalid = false;
+
+        // Send the address of the next queued line.
+        if (queue_count > aw_sent) {
+            Line &line = lines[queue[(queue_head + aw_sent) % queue.size()]];
+            in.awvalid = true;
+            in.awaddr = line.tag * line_bytes;
+            in.awlen = 0;
+            in.awsize = log2_line();
+            in.awburst = 1;
+            in.awid = 0;
+            if (dram.out.awready) {
+                aw_sent++;
+                outstanding++;
+            }
+        }
+
+        // Send the data of a line whose address was accepted on an earlier cycle.
+        if (w_pending > 0 && dram.out.wready) {
+            Line &line = lines[queue[queue_head]];
+            in.wvalid = true;
+            in.wdata = line.data.data();
+            in.wstrb = line.mask;
+            in.wlast = true;
+            if (line.mask == full_mask) {
+                stats.full_beats++;
+            } else {
+                stats.partial_beats++;
+            }
+            line.state = FREE;
+            line.mask = 0;
+            queue_head = (queue_head + 1) % queue.size();
+            queue_count--;
+            aw_sent--;
+            w_pending--;
+        }
+        // Addresses accepted this cycle have their data sent from the next cycle on.
+        w_pending = aw_sent;
+
+        if (dram.out.bvalid) {
+            outstanding--;
+        }
+    }
+
+private:
+    enum State { FREE, FILLING, QUEUED };
+
+    typedef struct Line {
+        State state = FREE;
+        size_t tag = 0;
+        uint64_t mask = 0;
+        uint64_t age = 0;
+        std::vector<uint8_t> data;
+    } Line;
+
+    int line_bytes;
+    uint64_t full_mask;
+    std::vector<Line> lines;
+    std::vector<int> queue; // Ring of lines waiting to be written, in order
+    int queue_head = 0;
+    int queue_count = 0;
+    int aw_sent = 0;        // Queued lines whose AW was accepted
+    int w_pending = 0;      // Of those, lines whose W can be sent
+    int outstanding = 0;    // Writes waiting for a B response
+    uint64_t age = 0;
+
+    size_t log2_line() const {
+        size_t n = 0;
+        while ((1 << n) < line_bytes) n++;
+        return n;
+    }
+
+    Line *find(size_t tag) {
+        for (Line &line : lines) {
+            if (line.state == FILLING && line.tag == tag) return &line;
+        }
+        return nullptr;
+    }
+
+    Line *allocate(size_t tag) {
+        for (Line &line : lines) {
+            if (line.state == FREE) {
+                line.state = FILLING;
+                line.tag = tag;
+                line.mask = 0;
+                line.age = age++;
+                return &line;
+            }
+        }
+        return nullptr;
+    }
+
+    void evict_oldest() {
+        Line *oldest = nullptr;
+        for (Line &line : lines) {
+            if (line.state == FILLING && (!oldest || line.age < oldest->age)) oldest = &line;
+        }
+        if (oldest) {
+            enqueue(*oldest);
+        }
+    }
+
+    void enqueue(Line &line) {
+        line.state = QUEUED;
+        queue[(queue_head + queue_count) % queue.size()] = (int)(&line - lines.data());
+        queue_count++;
+    }
+};
+
+#endif // WRITE_COMBINER_H